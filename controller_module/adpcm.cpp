@@ -0,0 +1,106 @@
+#include "adpcm.h"
+
+#include "mix_kernels.h"
+
+#if MIX_KERNELS_USE_DSP
+#include <arm_acle.h>
+#endif
+
+static const int16_t k_step_table[ADPCM_STEP_INDEX_MAX + 1u] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+    544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+    9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int8_t k_index_adjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+size_t sample_storage_bytes(sample_encoding_t encoding, uint32_t frame_count) {
+    if (encoding == SAMPLE_ENCODING_FRAMES) {
+        return frame_count * sizeof(uint32_t);
+    }
+    const uint32_t block_count = (frame_count + ADPCM_BLOCK_FRAMES - 1u) / ADPCM_BLOCK_FRAMES;
+    return block_count * adpcm_block_bytes(adpcm_channel_count(encoding));
+}
+
+// One code: the difference is (code magnitude + 1/2) steps / 4, computed with a
+// multiply instead of the reference shift-and-add chain. convert_sample.py encodes
+// against exactly this rounding.
+static inline int32_t decode_code(uint32_t code, int32_t *predictor, int32_t *index) {
+    const int32_t step = k_step_table[*index];
+    int32_t diff = static_cast<int32_t>(((code & 7u) * 2u + 1u) * static_cast<uint32_t>(step)) >> 3;
+    if (code & 8u) {
+        diff = -diff;
+    }
+
+#if MIX_KERNELS_USE_DSP
+    *predictor = __ssat(*predictor + diff, 16);
+#else
+    *predictor += diff;
+    if (*predictor > INT16_MAX) {
+        *predictor = INT16_MAX;
+    } else if (*predictor < INT16_MIN) {
+        *predictor = INT16_MIN;
+    }
+#endif
+
+    *index += k_index_adjust[code & 7u];
+    if (*index < 0) {
+        *index = 0;
+    } else if (*index > static_cast<int32_t>(ADPCM_STEP_INDEX_MAX)) {
+        *index = ADPCM_STEP_INDEX_MAX;
+    }
+    return *predictor;
+}
+
+// Decodes the first `end` samples of one channel of a block.
+static void decode_channel(const uint8_t *header, const uint8_t *codes, uint32_t end, int16_t *samples) {
+    int32_t predictor = static_cast<int16_t>(header[0] | (header[1] << 8u));
+    int32_t index = header[2] > ADPCM_STEP_INDEX_MAX ? ADPCM_STEP_INDEX_MAX : header[2];
+    samples[0] = static_cast<int16_t>(predictor);
+
+    // Two codes per byte; frame i uses code i - 1.
+    uint32_t i = 1u;
+    for (; i + 2u <= end; i += 2u) {
+        const uint32_t byte = codes[(i - 1u) >> 1u];
+        samples[i] = static_cast<int16_t>(decode_code(byte & 0xfu, &predictor, &index));
+        samples[i + 1u] = static_cast<int16_t>(decode_code(byte >> 4u, &predictor, &index));
+    }
+    if (i < end) {
+        samples[i] = static_cast<int16_t>(decode_code(codes[(i - 1u) >> 1u] & 0xfu, &predictor, &index));
+    }
+}
+
+void adpcm_decode_frames(const uint8_t *data, uint32_t channel_count, uint32_t first_frame, uint32_t frame_count,
+                         uint32_t *frames) {
+    const size_t block_bytes = adpcm_block_bytes(channel_count);
+    int16_t left[ADPCM_BLOCK_FRAMES];
+    int16_t right[ADPCM_BLOCK_FRAMES];
+
+    while (frame_count > 0u) {
+        const uint32_t block = first_frame / ADPCM_BLOCK_FRAMES;
+        const uint32_t start = first_frame % ADPCM_BLOCK_FRAMES;
+        const uint32_t count = ADPCM_BLOCK_FRAMES - start < frame_count ? ADPCM_BLOCK_FRAMES - start : frame_count;
+        const uint8_t *block_data = data + block * block_bytes;
+        const uint8_t *codes = block_data + channel_count * ADPCM_CHANNEL_HEADER_BYTES;
+
+        decode_channel(block_data, codes, start + count, left);
+        if (channel_count == 2u) {
+            decode_channel(block_data + ADPCM_CHANNEL_HEADER_BYTES, codes + ADPCM_CHANNEL_CODE_BYTES, start + count,
+                           right);
+            for (uint32_t i = 0; i < count; ++i) {
+                frames[i] = pack_i2s_frame(left[start + i], right[start + i]);
+            }
+        } else {
+            for (uint32_t i = 0; i < count; ++i) {
+                frames[i] = pack_i2s_frame(left[start + i], left[start + i]);
+            }
+        }
+
+        frames += count;
+        first_frame += count;
+        frame_count -= count;
+    }
+}
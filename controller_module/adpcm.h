@@ -0,0 +1,45 @@
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "i2s_frame.h"
+
+// IMA-ADPCM sample storage, 4 bits per sample plus a small per-block header. Samples
+// are encoded on the host by convert_sample.py --adpcm and decoded a block at a time
+// by the voice renderer as it plays, so they stay compressed in the sample cache.
+//
+// A block holds ADPCM_BLOCK_FRAMES frames and can be decoded on its own. For each
+// channel (left first) it starts with a 4-byte header:
+//
+//   0  s16  the block's first sample, stored exactly
+//   2  u8   step index (0-88) in force after the first sample
+//   3  u8   reserved, 0
+//
+// followed, channel after channel, by ADPCM_BLOCK_FRAMES / 2 bytes of 4-bit codes for
+// the remaining frames, low nibble first (the final nibble is padding). The last
+// block of a sample is padded to full length.
+#define ADPCM_BLOCK_FRAMES 64u
+#define ADPCM_CHANNEL_HEADER_BYTES 4u
+#define ADPCM_CHANNEL_CODE_BYTES (ADPCM_BLOCK_FRAMES / 2u)
+#define ADPCM_STEP_INDEX_MAX 88u
+
+static inline uint32_t adpcm_channel_count(sample_encoding_t encoding) {
+    return encoding == SAMPLE_ENCODING_ADPCM_STEREO ? 2u : 1u;
+}
+
+static inline size_t adpcm_block_bytes(uint32_t channel_count) {
+    return channel_count * (ADPCM_CHANNEL_HEADER_BYTES + ADPCM_CHANNEL_CODE_BYTES);
+}
+
+// Bytes taken by `frame_count` frames stored in `encoding`, counting whole blocks.
+size_t sample_storage_bytes(sample_encoding_t encoding, uint32_t frame_count);
+
+// Decodes frames [first_frame, first_frame + frame_count) of the ADPCM sample at
+// `data` into packed I2S frames; mono samples are duplicated to both sides. Each
+// block touched is decoded from its header, so any range can be decoded directly.
+void adpcm_decode_frames(const uint8_t *data, uint32_t channel_count, uint32_t first_frame, uint32_t frame_count,
+                         uint32_t *frames);
+
+#endif  // ADPCM_H
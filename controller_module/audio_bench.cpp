@@ -0,0 +1,133 @@
+#include "audio_bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "adpcm.h"
+#include "i2s_frame.h"
+#include "voice_mixer.h"
+#include "mix_kernels.h"
+
+#define AUDIO_BENCH_BLOCKS 32u
+
+// Long enough that no voice runs out during the benchmark, even an octave up.
+#define AUDIO_BENCH_SAMPLE_FRAMES (AUDIO_BENCH_BLOCKS * MIXER_BLOCK_FRAMES * 2u + 2u)
+
+#define AUDIO_BENCH_KERNEL_REPEATS 64u
+
+static uint32_t g_bench_block[MIXER_BLOCK_FRAMES * 2u];  // Room for 32-bit output.
+static int32_t g_bench_bus[MIXER_BLOCK_FRAMES * 2u];
+static mix_output_t g_bench_output = {VOICE_GAIN_UNITY / 2u, true, 1u, {0, 0}};
+
+// Converts the time for AUDIO_BENCH_KERNEL_REPEATS passes over one block into
+// core cycles per frame, in hundredths.
+static uint32_t cycles_per_frame_x100(uint64_t elapsed_us) {
+    const uint64_t cycles = elapsed_us * clock_get_hz(clk_sys) / 1000000u;
+    return static_cast<uint32_t>(cycles * 100u / (AUDIO_BENCH_KERNEL_REPEATS * MIXER_BLOCK_FRAMES));
+}
+
+static void print_kernel_result(const char *name, uint64_t elapsed_us) {
+    const uint32_t cycles_x100 = cycles_per_frame_x100(elapsed_us);
+    printf("Kernel %-16s %3lu.%02lu cycles per frame\n", name,
+           static_cast<unsigned long>(cycles_x100 / 100u), static_cast<unsigned long>(cycles_x100 % 100u));
+}
+
+static void bench_kernels(const uint32_t *frames) {
+    printf("Mix kernels: %s\n", MIX_KERNELS_USE_DSP ? "ARMv8-M DSP" : "portable C");
+
+    uint64_t start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        mix_accumulate_frames(g_bench_bus, frames, MIXER_BLOCK_FRAMES, VOICE_GAIN_UNITY / 4);
+    }
+    print_kernel_result("accumulate", time_us_64() - start_us);
+
+    start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        mix_output_frames(g_bench_block, g_bench_bus, MIXER_BLOCK_FRAMES, &g_bench_output);
+    }
+    print_kernel_result("output 16", time_us_64() - start_us);
+
+    start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        mix_output_words32(g_bench_block, g_bench_bus, MIXER_BLOCK_FRAMES, &g_bench_output);
+    }
+    print_kernel_result("output 32", time_us_64() - start_us);
+
+    const uint8_t *pcm8 = reinterpret_cast<const uint8_t *>(frames);
+    start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        mix_expand_u8_mono_to_frames(g_bench_block, pcm8, MIXER_BLOCK_FRAMES);
+    }
+    print_kernel_result("expand u8 mono", time_us_64() - start_us);
+
+    start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        mix_expand_u8_stereo_to_frames(g_bench_block, pcm8, MIXER_BLOCK_FRAMES);
+    }
+    print_kernel_result("expand u8 stereo", time_us_64() - start_us);
+
+    // Decode cost does not depend on the codes, so any bytes will do.
+    start_us = time_us_64();
+    for (uint32_t i = 0; i < AUDIO_BENCH_KERNEL_REPEATS; ++i) {
+        adpcm_decode_frames(pcm8, 2u, 0u, MIXER_BLOCK_FRAMES, g_bench_block);
+    }
+    print_kernel_result("adpcm stereo", time_us_64() - start_us);
+}
+
+// Fills the voice pool with `pitch_step` voices and times AUDIO_BENCH_BLOCKS renders.
+static void bench_mixer(const char *name, const uint32_t *frames, sample_encoding_t encoding, uint32_t pitch_step,
+                        uint32_t output_rate_hz) {
+    voice_mixer_init();
+
+    voice_params_t params = {};
+    params.data = frames;
+    params.encoding = encoding;
+    params.frame_count = AUDIO_BENCH_SAMPLE_FRAMES;
+    params.gain = VOICE_GAIN_UNITY / MIXER_VOICE_COUNT;
+    params.velocity = 127u;
+    params.pitch_step = pitch_step;
+    for (uint32_t i = 0; i < MIXER_VOICE_COUNT; ++i) {
+        voice_mixer_note_on(static_cast<uint8_t>(i), &params);
+    }
+
+    const uint64_t start_us = time_us_64();
+    for (uint32_t block = 0; block < AUDIO_BENCH_BLOCKS; ++block) {
+        voice_mixer_render(g_bench_block, MIXER_BLOCK_FRAMES);
+    }
+    const uint64_t elapsed_us = time_us_64() - start_us;
+
+    // One voice for 1 ms of audio is output_rate_hz / 1000 voice-frames.
+    const uint64_t voice_frames = static_cast<uint64_t>(AUDIO_BENCH_BLOCKS) * MIXER_BLOCK_FRAMES * MIXER_VOICE_COUNT;
+    const uint64_t voice_ms = voice_frames * 1000u / output_rate_hz;
+    const uint32_t voices_per_ms = elapsed_us ? static_cast<uint32_t>(voice_ms * 1000u / elapsed_us) : 0u;
+
+    printf("Bench %-10s %6lu us for %lu voice-frames, %lu voices per ms of core time\n",
+           name, static_cast<unsigned long>(elapsed_us), static_cast<unsigned long>(voice_frames),
+           static_cast<unsigned long>(voices_per_ms));
+}
+
+void audio_bench_run(uint32_t output_rate_hz) {
+    uint32_t *frames = static_cast<uint32_t *>(std::malloc(AUDIO_BENCH_SAMPLE_FRAMES * sizeof(uint32_t)));
+    if (!frames) {
+        printf("Bench: out of memory\n");
+        return;
+    }
+
+    // A sawtooth keeps the interpolation from collapsing to a constant.
+    for (uint32_t i = 0; i < AUDIO_BENCH_SAMPLE_FRAMES; ++i) {
+        const int16_t value = static_cast<int16_t>((i * 517u) & 0xffffu);
+        frames[i] = pack_i2s_frame(value, static_cast<int16_t>(-value));
+    }
+
+    bench_kernels(frames);
+    bench_mixer("direct", frames, SAMPLE_ENCODING_FRAMES, VOICE_PITCH_UNITY, output_rate_hz);
+    bench_mixer("resampled", frames, SAMPLE_ENCODING_FRAMES, voice_pitch_step(7, 0u, 0u), output_rate_hz);
+    // The sawtooth's bytes stand in for ADPCM blocks; it is large enough to hold them.
+    bench_mixer("adpcm", frames, SAMPLE_ENCODING_ADPCM_STEREO, VOICE_PITCH_UNITY, output_rate_hz);
+    bench_mixer("adpcm rs", frames, SAMPLE_ENCODING_ADPCM_STEREO, voice_pitch_step(7, 0u, 0u), output_rate_hz);
+
+    voice_mixer_init();
+    std::free(frames);
+}
@@ -0,0 +1,11 @@
+#ifndef AUDIO_BENCH_H
+#define AUDIO_BENCH_H
+
+#include <stdint.h>
+
+// Times the mix kernels and renders mixer blocks on the calling core with output
+// stopped, printing how expensive each render path is. Run it on core 1, before starting I2S output,
+// to size MIXER_VOICE_COUNT against the real-time budget.
+void audio_bench_run(uint32_t output_rate_hz);
+
+#endif  // AUDIO_BENCH_H
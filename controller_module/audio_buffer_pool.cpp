@@ -0,0 +1,142 @@
+#include "audio_buffer_pool.h"
+
+#include <cassert>
+#include <cstring>
+
+// List handling as in reference/audio.cpp: the free list is a stack, the prepared
+// list a FIFO with a tail pointer so buffers play in the order they were rendered.
+
+inline static audio_buffer_t *list_remove_head(audio_buffer_t **phead) {
+    audio_buffer_t *ab = *phead;
+
+    if (ab) {
+        *phead = ab->next;
+        ab->next = nullptr;
+    }
+
+    return ab;
+}
+
+inline static audio_buffer_t *list_remove_head_with_tail(audio_buffer_t **phead, audio_buffer_t **ptail) {
+    audio_buffer_t *ab = *phead;
+
+    if (ab) {
+        *phead = ab->next;
+
+        if (!ab->next) {
+            assert(*ptail == ab);
+            *ptail = nullptr;
+        } else {
+            ab->next = nullptr;
+        }
+    }
+
+    return ab;
+}
+
+inline static void list_prepend(audio_buffer_t **phead, audio_buffer_t *ab) {
+    assert(ab->next == nullptr);
+    assert(ab != *phead);
+    ab->next = *phead;
+    *phead = ab;
+}
+
+inline static void list_append_with_tail(audio_buffer_t **phead, audio_buffer_t **ptail, audio_buffer_t *ab) {
+    assert(ab->next == nullptr);
+    assert(ab != *phead);
+    assert(ab != *ptail);
+
+    if (!*phead) {
+        assert(!*ptail);
+        *ptail = ab;
+        list_prepend(phead, ab);
+    } else {
+        (*ptail)->next = ab;
+        *ptail = ab;
+    }
+}
+
+void audio_buffer_pool_init(audio_buffer_pool_t *pool, audio_buffer_t *buffers, uint32_t *frames,
+                            uint32_t buffer_count, uint32_t frames_per_buffer, uint32_t words_per_frame) {
+    std::memset(pool, 0, sizeof(*pool));
+
+    for (uint32_t i = 0; i < buffer_count; ++i) {
+        buffers[i].frames = frames + i * frames_per_buffer * words_per_frame;
+        buffers[i].frame_count = frames_per_buffer;
+        buffers[i].next = i != buffer_count - 1u ? &buffers[i + 1u] : nullptr;
+    }
+
+    pool->free_list_spin_lock = spin_lock_init(spin_lock_claim_unused(true));
+    pool->free_list = buffer_count ? buffers : nullptr;
+    pool->prepared_list_spin_lock = spin_lock_init(spin_lock_claim_unused(true));
+    pool->stats.min_depth = buffer_count;
+}
+
+audio_buffer_t *get_free_audio_buffer(audio_buffer_pool_t *pool, bool block) {
+    audio_buffer_t *ab;
+
+    do {
+        uint32_t save = spin_lock_blocking(pool->free_list_spin_lock);
+        ab = list_remove_head(&pool->free_list);
+        spin_unlock(pool->free_list_spin_lock, save);
+        if (ab || !block) break;
+        __wfe();
+    } while (true);
+    return ab;
+}
+
+void queue_free_audio_buffer(audio_buffer_pool_t *pool, audio_buffer_t *ab) {
+    assert(!ab->next);
+    uint32_t save = spin_lock_blocking(pool->free_list_spin_lock);
+    list_prepend(&pool->free_list, ab);
+    spin_unlock(pool->free_list_spin_lock, save);
+    __sev();
+}
+
+audio_buffer_t *get_full_audio_buffer(audio_buffer_pool_t *pool, bool block) {
+    audio_buffer_t *ab;
+
+    do {
+        uint32_t save = spin_lock_blocking(pool->prepared_list_spin_lock);
+        ab = list_remove_head_with_tail(&pool->prepared_list, &pool->prepared_list_tail);
+        if (ab) {
+            --pool->stats.depth;
+        } else if (!block) {
+            ++pool->stats.underruns;
+        }
+        if (pool->stats.depth < pool->stats.min_depth) {
+            pool->stats.min_depth = pool->stats.depth;
+        }
+        spin_unlock(pool->prepared_list_spin_lock, save);
+        if (ab || !block) break;
+        __wfe();
+    } while (true);
+    return ab;
+}
+
+void queue_full_audio_buffer(audio_buffer_pool_t *pool, audio_buffer_t *ab) {
+    assert(!ab->next);
+    uint32_t save = spin_lock_blocking(pool->prepared_list_spin_lock);
+    list_append_with_tail(&pool->prepared_list, &pool->prepared_list_tail, ab);
+    ++pool->stats.depth;
+    // The consumer went without since the last block, so this one is late.
+    if (pool->stats.underruns != pool->underruns_seen) {
+        ++pool->stats.overruns;
+        pool->underruns_seen = pool->stats.underruns;
+    }
+    spin_unlock(pool->prepared_list_spin_lock, save);
+    __sev();
+}
+
+audio_buffer_pool_stats_t audio_buffer_pool_get_stats(audio_buffer_pool_t *pool) {
+    uint32_t save = spin_lock_blocking(pool->prepared_list_spin_lock);
+    audio_buffer_pool_stats_t stats = pool->stats;
+    spin_unlock(pool->prepared_list_spin_lock, save);
+    return stats;
+}
+
+void audio_buffer_pool_reset_min_depth(audio_buffer_pool_t *pool) {
+    uint32_t save = spin_lock_blocking(pool->prepared_list_spin_lock);
+    pool->stats.min_depth = pool->stats.depth;
+    spin_unlock(pool->prepared_list_spin_lock, save);
+}
@@ -0,0 +1,54 @@
+#ifndef AUDIO_BUFFER_POOL_H
+#define AUDIO_BUFFER_POOL_H
+
+#include <stdint.h>
+
+#include "hardware/sync.h"
+
+// Producer/consumer pool of packed I2S frame buffers, after the pico-extras
+// audio_buffer_pool_t in reference/audio.cpp. The producer takes free buffers,
+// renders into them and queues them as full; the consumer takes full buffers in
+// order and hands them back as free. Each list has its own spin lock, and queueing
+// a buffer issues __sev() so a blocked taker waiting in __wfe() wakes up.
+typedef struct audio_buffer {
+    uint32_t *frames;  // frame_count frames of one or two FIFO words each.
+    uint32_t frame_count;
+    struct audio_buffer *next;
+} audio_buffer_t;
+
+typedef struct audio_buffer_pool_stats {
+    uint32_t depth;       // Full buffers waiting for the consumer right now.
+    uint32_t min_depth;   // Lowest depth seen by the consumer: the remaining safety margin.
+    uint32_t underruns;   // Consumer found no full buffer.
+    uint32_t overruns;    // Producer queued a block past its deadline: the consumer had underrun waiting for it.
+} audio_buffer_pool_stats_t;
+
+typedef struct audio_buffer_pool {
+    spin_lock_t *free_list_spin_lock;
+    audio_buffer_t *free_list;
+    spin_lock_t *prepared_list_spin_lock;
+    audio_buffer_t *prepared_list;
+    audio_buffer_t *prepared_list_tail;
+    audio_buffer_pool_stats_t stats;  // Under the prepared-list lock.
+    uint32_t underruns_seen;          // stats.underruns when the producer last queued a block.
+} audio_buffer_pool_t;
+
+// Links `buffer_count` buffers over `frames` (buffer_count * frames_per_buffer *
+// words_per_frame words) into the free list and claims the pool's two spin locks.
+void audio_buffer_pool_init(audio_buffer_pool_t *pool, audio_buffer_t *buffers, uint32_t *frames,
+                            uint32_t buffer_count, uint32_t frames_per_buffer, uint32_t words_per_frame);
+
+// Producer side.
+audio_buffer_t *get_free_audio_buffer(audio_buffer_pool_t *pool, bool block);
+void queue_full_audio_buffer(audio_buffer_pool_t *pool, audio_buffer_t *buffer);
+
+// Consumer side; safe to call from an IRQ with block = false.
+audio_buffer_t *get_full_audio_buffer(audio_buffer_pool_t *pool, bool block);
+void queue_free_audio_buffer(audio_buffer_pool_t *pool, audio_buffer_t *buffer);
+
+audio_buffer_pool_stats_t audio_buffer_pool_get_stats(audio_buffer_pool_t *pool);
+
+// Restarts min_depth from the current depth; the event counters keep running.
+void audio_buffer_pool_reset_min_depth(audio_buffer_pool_t *pool);
+
+#endif  // AUDIO_BUFFER_POOL_H
@@ -1,5 +1,4 @@
 #include <cstdio>
-#include <cstdlib>
 #include <cstring>
 #include <string>
 #include "pico/stdlib.h"
@@ -10,12 +9,31 @@
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
+#include "hardware/irq.h"
 #include "hardware/uart.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 #include "ff.h"
 #include "mcp2515/mcp2515.h"
 #include "wav_sample.h"
+#include "i2s_frame.h"
+#include "native_sample.h"
+#include "adpcm.h"
+#include "i2s_clock.h"
+#include "sample_file.h"
+#include "voice_mixer.h"
+#include "mix_kernels.h"
+#include "sample_cache.h"
+#include "audio_bench.h"
+#include "audio_buffer_pool.h"
+#include "note_event_queue.h"
+#include "keymap.h"
+#include "preloader.h"
+#include "wavetable.h"
+#include "effects.h"
+#include "hw_config.h"
+#include "sd_card.h"
+#include "spi.h"
 
 // SPI Defines
 // We are going to use SPI 0, and allocate it to the following GPIO pins
@@ -39,6 +57,23 @@
 #define I2S_LRCLK_PIN 23
 #define I2S_DIN_PIN 24
 
+// The SD card driver owns DMA_IRQ_0, so continuous audio output uses the other line.
+#define I2S_DMA_IRQ DMA_IRQ_1
+
+// Set to 32 for 32-bit I2S slots carrying 24 bits of the mix bus, two FIFO words per
+// frame at 64 BCLKs per frame; the DAC must take 32-bit words.
+#define I2S_OUTPUT_BITS 16
+#define I2S_FRAME_WORDS (I2S_OUTPUT_BITS / 16u)
+#define I2S_PIO_CYCLES_PER_FRAME (I2S_OUTPUT_BITS == 32 ? I2S_PIO_CYCLES_PER_FRAME_32 : I2S_PIO_CYCLES_PER_FRAME_16)
+
+// Set to 1 to move clk_sys at boot to the PLL setting in the range below whose PIO
+// divider lands closest to I2S_NOMINAL_SAMPLE_RATE_HZ. For 44.1 kHz with 16-bit slots
+// that is 138 MHz at +0.5 ppm, against +32.5 ppm at the default 150 MHz.
+#define I2S_RETUNE_SYS_CLOCK 0
+#define I2S_NOMINAL_SAMPLE_RATE_HZ 44100u
+#define I2S_SYS_CLOCK_MIN_HZ 120000000u
+#define I2S_SYS_CLOCK_MAX_HZ 150000000u
+
 // I2C defines
 // This example will use I2C0 on GPIO8 (SDA) and GPIO9 (SCL) running at 400KHz.
 // Pins can be changed, see the GPIO function select table in the datasheet for information on GPIO assignments
@@ -61,372 +96,907 @@ char dst[count_of(src)];
 #define UART_RX_PIN 9
 
 
-void can_init() {
-    MCP2515 mcp2515(spi0, CAN_CS, CAN_MOSI, CAN_MISO, CAN_SCK);
-    
+// Key events from the hall effect boards: data[0] is the MIDI note, data[1] the velocity.
+#define CAN_ID_NOTE_ON 0x100
+#define CAN_ID_NOTE_OFF 0x101
+
+// Must match the hall effect boards' CAN_BITRATE, or nothing acknowledges their frames.
+#define CAN_BITRATE CAN_500KBPS
+
+// Sent by core 1 over the multicore FIFO once its boot-time SD card access is done.
+// From then on core 0 owns the card (FatFs is not shared between cores).
+#define CORE1_READY_TOKEN 0xC0DE0001u
+
+void can_init(MCP2515 &mcp2515) {
     // ADC Initialization
 
     mcp2515.reset();
 
-    mcp2515.setBitrate(CAN_5KBPS, MCP_8MHZ);
+    mcp2515.setBitrate(CAN_BITRATE, MCP_8MHZ);
     mcp2515.setNormalMode();
 }
 
 static PIO g_i2s_pio = pio0;
 static int g_i2s_sm = -1;
-static int g_i2s_dma_channel = -1;
 static uint g_i2s_program_offset = 0;
 static bool g_i2s_initialized = false;
 static uint32_t g_i2s_sample_rate_hz = 0;
 
-static inline uint16_t read_u16_le(const uint8_t *bytes) {
-    return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+// sample_reader_t over an open FatFs file, for the parsers in sample_file.h.
+static bool fatfs_read(void *context, void *data, uint32_t byte_count) {
+    UINT bytes_read = 0;
+    return f_read(static_cast<FIL *>(context), data, byte_count, &bytes_read) == FR_OK && bytes_read == byte_count;
 }
 
-static inline uint32_t read_u32_le(const uint8_t *bytes) {
-    return static_cast<uint32_t>(bytes[0]) |
-           (static_cast<uint32_t>(bytes[1]) << 8u) |
-           (static_cast<uint32_t>(bytes[2]) << 16u) |
-           (static_cast<uint32_t>(bytes[3]) << 24u);
+static bool fatfs_seek(void *context, uint32_t offset) {
+    return f_lseek(static_cast<FIL *>(context), offset) == FR_OK;
 }
 
-static inline uint32_t pack_i2s_frame(int16_t left, int16_t right) {
-    return (static_cast<uint32_t>(static_cast<uint16_t>(left)) << 16u) |
-           static_cast<uint16_t>(right);
+static uint32_t fatfs_tell(void *context) {
+    return static_cast<uint32_t>(f_tell(static_cast<FIL *>(context)));
 }
 
-static bool seek_forward(FIL *file, uint32_t byte_count) {
-    const FSIZE_t current = f_tell(file);
-    return f_lseek(file, current + byte_count) == FR_OK;
+static sample_reader_t fatfs_reader(FIL *file) {
+    return {file, fatfs_read, fatfs_seek, fatfs_tell, static_cast<uint32_t>(f_size(file))};
 }
 
-static bool load_wav(const std::string &filename, wav_sample_t *sample) {
-    FIL file;
-    std::memset(sample, 0, sizeof(*sample));
-
-    if (f_open(&file, filename.c_str(), FA_READ) != FR_OK) {
-        printf("Failed to open WAV file: %s\n", filename.c_str());
+// Opens either a native sample or a WAV file, detected by its magic, and leaves the
+// file positioned at the first frame. Exactly one of `native`/`wav` is filled in.
+static bool open_sample(const std::string &filename, FIL *file, bool *is_native,
+                        native_sample_header_t *native, wav_sample_t *wav) {
+    if (f_open(file, filename.c_str(), FA_READ) != FR_OK) {
+        printf("Failed to open sample file: %s\n", filename.c_str());
         return false;
     }
 
-    uint8_t riff_header[12];
-    UINT bytes_read = 0;
-    if (f_read(&file, riff_header, sizeof(riff_header), &bytes_read) != FR_OK || bytes_read != sizeof(riff_header)) {
-        printf("Failed to read WAV header: %s\n", filename.c_str());
-        f_close(&file);
+    const sample_reader_t reader = fatfs_reader(file);
+    if (!parse_sample(&reader, filename.c_str(), is_native, native, wav)) {
+        f_close(file);
         return false;
     }
+    return true;
+}
 
-    if (std::memcmp(riff_header, "RIFF", 4) != 0 || std::memcmp(riff_header + 8, "WAVE", 4) != 0) {
-        printf("Not a RIFF/WAVE file: %s\n", filename.c_str());
-        f_close(&file);
+// Sample cache loader: reads one sample at a time in chunks. Native samples, frames
+// or ADPCM blocks, are read straight into the cache's buffer; WAV PCM goes through a
+// scratch buffer and convert_pcm_to_i2s_frames().
+#define SAMPLE_LOAD_SCRATCH_FRAMES 256u
+
+static FIL g_load_file;
+static bool g_load_is_native = false;
+static sample_encoding_t g_load_encoding = SAMPLE_ENCODING_FRAMES;
+static wav_sample_t g_load_wav;
+static FSIZE_t g_load_data_offset = 0u;
+static uint32_t g_load_scratch[SAMPLE_LOAD_SCRATCH_FRAMES];  // Up to 4 bytes of PCM per frame.
+
+static bool open_cached_sample(const char *path, sample_frames_t *sample) {
+    native_sample_header_t native;
+    if (!open_sample(path, &g_load_file, &g_load_is_native, &native, &g_load_wav)) {
         return false;
     }
 
-    bool found_fmt = false;
-    bool found_data = false;
+    g_load_data_offset = f_tell(&g_load_file);
+    g_load_encoding = g_load_is_native ? native_sample_encoding(&native) : SAMPLE_ENCODING_FRAMES;
+    sample->encoding = g_load_encoding;
+    if (g_load_is_native) {
+        sample->frame_count = native.frame_count;
+        sample->sample_rate_hz = native.sample_rate_hz;
+        sample->loop_start = native.loop_start;
+        sample->loop_end = native.loop_end;
+    } else {
+        sample->frame_count = static_cast<uint32_t>(g_load_wav.data_size_bytes / g_load_wav.block_align);
+        sample->sample_rate_hz = g_load_wav.sample_rate_hz;
+        sample->loop_start = g_load_wav.loop_start;
+        sample->loop_end = g_load_wav.loop_end;
+    }
+    return true;
+}
+
+static bool read_cached_sample(void *data, uint32_t frame_count) {
+    UINT bytes_read = 0;
+    if (g_load_is_native) {
+        const UINT byte_count = static_cast<UINT>(sample_storage_bytes(g_load_encoding, frame_count));
+        return f_read(&g_load_file, data, byte_count, &bytes_read) == FR_OK && bytes_read == byte_count;
+    }
 
-    while (f_tell(&file) + 8 <= f_size(&file)) {
-        uint8_t chunk_header[8];
-        if (f_read(&file, chunk_header, sizeof(chunk_header), &bytes_read) != FR_OK || bytes_read != sizeof(chunk_header)) {
-            break;
+    uint32_t *frames = static_cast<uint32_t *>(data);
+    while (frame_count > 0u) {
+        const uint32_t count = frame_count < SAMPLE_LOAD_SCRATCH_FRAMES ? frame_count : SAMPLE_LOAD_SCRATCH_FRAMES;
+        const UINT byte_count = count * g_load_wav.block_align;
+        if (f_read(&g_load_file, g_load_scratch, byte_count, &bytes_read) != FR_OK || bytes_read != byte_count) {
+            return false;
         }
+        convert_pcm_to_i2s_frames(g_load_wav, reinterpret_cast<const uint8_t *>(g_load_scratch), count, frames);
+        frames += count;
+        frame_count -= count;
+    }
+    return true;
+}
 
-        const uint32_t chunk_size = read_u32_le(chunk_header + 4);
-        const uint32_t padded_chunk_size = chunk_size + (chunk_size & 1u);
+static bool seek_cached_sample(uint32_t frame) {
+    const FSIZE_t offset = g_load_is_native ? sample_storage_bytes(g_load_encoding, frame)
+                                            : static_cast<FSIZE_t>(frame) * g_load_wav.block_align;
+    return f_lseek(&g_load_file, g_load_data_offset + offset) == FR_OK;
+}
 
-        if (std::memcmp(chunk_header, "fmt ", 4) == 0) {
-            if (chunk_size < 16u) {
-                printf("Invalid fmt chunk in %s\n", filename.c_str());
-                f_close(&file);
-                return false;
-            }
+static void close_cached_sample() {
+    f_close(&g_load_file);
+}
 
-            uint8_t fmt_chunk[16];
-            if (f_read(&file, fmt_chunk, sizeof(fmt_chunk), &bytes_read) != FR_OK || bytes_read != sizeof(fmt_chunk)) {
-                printf("Failed to read fmt chunk in %s\n", filename.c_str());
-                f_close(&file);
-                return false;
-            }
+static uint32_t probe_sample_rate(const char *path) {
+    FIL file;
+    bool is_native = false;
+    native_sample_header_t native;
+    wav_sample_t sample;
+    if (!open_sample(path, &file, &is_native, &native, &sample)) {
+        return 0u;
+    }
+    f_close(&file);
+    return is_native ? native.sample_rate_hz : sample.sample_rate_hz;
+}
 
-            sample->audio_format = read_u16_le(fmt_chunk + 0);
-            sample->channel_count = read_u16_le(fmt_chunk + 2);
-            sample->sample_rate_hz = read_u32_le(fmt_chunk + 4);
-            sample->byte_rate = read_u32_le(fmt_chunk + 8);
-            sample->block_align = read_u16_le(fmt_chunk + 12);
-            sample->bits_per_sample = read_u16_le(fmt_chunk + 14);
-
-            if (padded_chunk_size > sizeof(fmt_chunk) && !seek_forward(&file, padded_chunk_size - sizeof(fmt_chunk))) {
-                printf("Failed to skip fmt extension in %s\n", filename.c_str());
-                f_close(&file);
-                return false;
-            }
+// Picks the PIO divider for `sample_rate_hz` at the current clk_sys and reports how
+// far the achieved rate is off.
+static bool compute_i2s_divider(uint32_t sample_rate_hz, i2s_clock_divider_t *divider) {
+    if (!i2s_clock_divider(clock_get_hz(clk_sys), sample_rate_hz, I2S_PIO_CYCLES_PER_FRAME, divider)) {
+        printf("I2S cannot run at %lu Hz\n", static_cast<unsigned long>(sample_rate_hz));
+        return false;
+    }
 
-            found_fmt = true;
-        } else if (std::memcmp(chunk_header, "data", 4) == 0) {
-            uint8_t *raw_data = static_cast<uint8_t *>(std::malloc(chunk_size));
-            if (!raw_data) {
-                printf("Out of memory loading WAV data: %s\n", filename.c_str());
-                f_close(&file);
-                return false;
-            }
+    const int32_t error_ppb = divider->error_ppb;
+    const uint32_t error_abs_ppb = static_cast<uint32_t>(error_ppb < 0 ? -error_ppb : error_ppb);
+    printf("I2S %lu Hz: divider %u+%u/256, achieved %lu.%03lu Hz (%c%lu.%03lu ppm)\n",
+           static_cast<unsigned long>(sample_rate_hz), divider->integer, divider->fraction,
+           static_cast<unsigned long>(divider->achieved_mhz / 1000u),
+           static_cast<unsigned long>(divider->achieved_mhz % 1000u), error_ppb < 0 ? '-' : '+',
+           static_cast<unsigned long>(error_abs_ppb / 1000u), static_cast<unsigned long>(error_abs_ppb % 1000u));
+    return true;
+}
 
-            if (f_read(&file, raw_data, chunk_size, &bytes_read) != FR_OK || bytes_read != chunk_size) {
-                printf("Failed to read WAV data: %s\n", filename.c_str());
-                std::free(raw_data);
-                f_close(&file);
-                return false;
-            }
+static bool init_i2s_output(uint32_t sample_rate_hz) {
+    if (!g_i2s_initialized) {
+        g_i2s_sm = pio_claim_unused_sm(g_i2s_pio, false);
+        if (g_i2s_sm < 0) {
+            printf("No free PIO state machine for I2S\n");
+            return false;
+        }
 
-            if ((chunk_size & 1u) && !seek_forward(&file, 1u)) {
-                printf("Failed to skip padded WAV byte: %s\n", filename.c_str());
-                std::free(raw_data);
-                f_close(&file);
-                return false;
-            }
+        gpio_set_function(I2S_DIN_PIN, GPIO_FUNC_PIO0);
+        gpio_set_function(I2S_BCLK_PIN, GPIO_FUNC_PIO0);
+        gpio_set_function(I2S_LRCLK_PIN, GPIO_FUNC_PIO0);
 
-            sample->data_size_bytes = chunk_size;
-            sample->data = raw_data;
-            found_data = true;
+        if (I2S_OUTPUT_BITS == 32) {
+            g_i2s_program_offset = pio_add_program(g_i2s_pio, &audio_i2s_32_swapped_program);
+            audio_i2s_32_swapped_program_init(g_i2s_pio, static_cast<uint>(g_i2s_sm), g_i2s_program_offset, I2S_DIN_PIN,
+                                              I2S_BCLK_PIN);
         } else {
-            if (!seek_forward(&file, padded_chunk_size)) {
-                printf("Failed to skip WAV chunk in %s\n", filename.c_str());
-                f_close(&file);
-                return false;
-            }
-        }
-
-        if (found_fmt && found_data) {
-            break;
+            g_i2s_program_offset = pio_add_program(g_i2s_pio, &audio_i2s_swapped_program);
+            audio_i2s_swapped_program_init(g_i2s_pio, static_cast<uint>(g_i2s_sm), g_i2s_program_offset, I2S_DIN_PIN, I2S_BCLK_PIN);
         }
-    }
-
-    f_close(&file);
 
-    if (!found_fmt || !found_data) {
-        printf("Missing fmt/data chunk in %s\n", filename.c_str());
-        std::free(const_cast<uint8_t *>(sample->data));
-        std::memset(sample, 0, sizeof(*sample));
-        return false;
-    }
-
-    if (sample->audio_format != 1u) {
-        printf("Unsupported WAV format %u in %s\n", sample->audio_format, filename.c_str());
-        std::free(const_cast<uint8_t *>(sample->data));
-        std::memset(sample, 0, sizeof(*sample));
-        return false;
+        g_i2s_initialized = true;
     }
 
-    if ((sample->channel_count != 1u && sample->channel_count != 2u) ||
-        (sample->bits_per_sample != 8u && sample->bits_per_sample != 16u) ||
-        sample->block_align == 0u || sample->sample_rate_hz == 0u) {
-        printf("Unsupported WAV layout in %s\n", filename.c_str());
-        std::free(const_cast<uint8_t *>(sample->data));
-        std::memset(sample, 0, sizeof(*sample));
-        return false;
+    if (g_i2s_sample_rate_hz != sample_rate_hz) {
+        i2s_clock_divider_t divider;
+        if (!compute_i2s_divider(sample_rate_hz, &divider)) {
+            return false;
+        }
+        pio_sm_set_clkdiv_int_frac(g_i2s_pio, static_cast<uint>(g_i2s_sm), divider.integer, divider.fraction);
+        g_i2s_sample_rate_hz = sample_rate_hz;
     }
 
     return true;
 }
 
-static bool build_i2s_frames(const wav_sample_t &sample, uint32_t **frames_out, size_t *frame_count_out) {
-    const size_t frame_count = sample.data_size_bytes / sample.block_align;
-    if (frame_count == 0u) {
-        return false;
-    }
+static void i2s_start() {
+    pio_sm_set_enabled(g_i2s_pio, static_cast<uint>(g_i2s_sm), false);
+    pio_sm_clear_fifos(g_i2s_pio, static_cast<uint>(g_i2s_sm));
+    pio_sm_restart(g_i2s_pio, static_cast<uint>(g_i2s_sm));
+    pio_sm_set_enabled(g_i2s_pio, static_cast<uint>(g_i2s_sm), true);
+}
 
-    uint32_t *frames = static_cast<uint32_t *>(std::malloc(frame_count * sizeof(uint32_t)));
-    if (!frames) {
-        return false;
-    }
+// Continuous output: two DMA channels, each chained to the other, so the PIO state
+// machine never stops. Buffers come from g_i2s_pool: core 1 renders into free
+// buffers and queues them full (i2s_render_next_buffer()); when a channel finishes,
+// the IRQ hands the buffer it played back to the free list and re-arms the channel
+// with the next full one, or with silence if the renderer has fallen behind.
+typedef void (*i2s_render_callback_t)(uint32_t *frames, uint32_t frame_count);
+
+// Total render buffers, two of which are always owned by the DMA channels. Output
+// latency is up to this many blocks; each extra buffer adds one block of margin
+// against render spikes (sample loads, voice count peaks).
+#define I2S_BUFFER_COUNT 4
+
+static audio_buffer_pool_t g_i2s_pool;
+static audio_buffer_t g_i2s_buffers[I2S_BUFFER_COUNT];
+static uint32_t g_i2s_buffer_frames[I2S_BUFFER_COUNT * MIXER_BLOCK_FRAMES * I2S_FRAME_WORDS];
+static const uint32_t g_i2s_silence[MIXER_BLOCK_FRAMES * I2S_FRAME_WORDS] = {0};
+static audio_buffer_t *g_i2s_dma_buffer[2] = {nullptr, nullptr};  // null while playing silence
+static int g_i2s_chain_dma[2] = {-1, -1};
+static bool g_i2s_streaming = false;
+
+// Rate changes while streaming: i2s_set_sample_rate() leaves the divider pending,
+// the producer tags the next buffer it renders with it, and the IRQ that sees that
+// buffer start playing loads it. Each buffer so plays at the rate it was rendered
+// for (less the IRQ latency, well under one frame) and the DMA chain never stops.
+static i2s_clock_divider_t g_i2s_pending_divider;
+static bool g_i2s_divider_pending = false;
+static i2s_clock_divider_t g_i2s_tagged_divider;
+static audio_buffer_t *volatile g_i2s_tagged_buffer = nullptr;
+
+// Points `half`'s channel at the next full buffer without triggering it; the partner
+// channel chains back to it.
+static void i2s_arm_chain_channel(uint half) {
+    audio_buffer_t *buffer = get_full_audio_buffer(&g_i2s_pool, false);
+    g_i2s_dma_buffer[half] = buffer;
+    dma_channel_set_read_addr(static_cast<uint>(g_i2s_chain_dma[half]), buffer ? buffer->frames : g_i2s_silence,
+                              false);
+}
 
-    if (sample.bits_per_sample == 16u) {
-        const int16_t *pcm16 = reinterpret_cast<const int16_t *>(sample.data);
-        if (sample.channel_count == 1u) {
-            for (size_t i = 0; i < frame_count; ++i) {
-                frames[i] = pack_i2s_frame(pcm16[i], pcm16[i]);
-            }
-        } else {
-            for (size_t i = 0; i < frame_count; ++i) {
-                frames[i] = pack_i2s_frame(pcm16[i * 2u], pcm16[i * 2u + 1u]);
-            }
+static void __isr i2s_chain_irq_handler() {
+    for (uint half = 0u; half < 2u; ++half) {
+        const uint channel = static_cast<uint>(g_i2s_chain_dma[half]);
+        if (!dma_channel_get_irq1_status(channel)) {
+            continue;
         }
-    } else {
-        const uint8_t *pcm8 = sample.data;
-        if (sample.channel_count == 1u) {
-            for (size_t i = 0; i < frame_count; ++i) {
-                const int16_t mono = static_cast<int16_t>((static_cast<int>(pcm8[i]) - 128) << 8);
-                frames[i] = pack_i2s_frame(mono, mono);
-            }
-        } else {
-            for (size_t i = 0; i < frame_count; ++i) {
-                const int16_t left = static_cast<int16_t>((static_cast<int>(pcm8[i * 2u]) - 128) << 8);
-                const int16_t right = static_cast<int16_t>((static_cast<int>(pcm8[i * 2u + 1u]) - 128) << 8);
-                frames[i] = pack_i2s_frame(left, right);
-            }
+        dma_channel_acknowledge_irq1(channel);
+
+        if (g_i2s_dma_buffer[half]) {
+            queue_free_audio_buffer(&g_i2s_pool, g_i2s_dma_buffer[half]);
+        }
+        i2s_arm_chain_channel(half);
+
+        // The partner channel has just started on its buffer.
+        audio_buffer_t *tagged = g_i2s_tagged_buffer;
+        if (tagged && g_i2s_dma_buffer[half ^ 1u] == tagged) {
+            pio_sm_set_clkdiv_int_frac(g_i2s_pio, static_cast<uint>(g_i2s_sm), g_i2s_tagged_divider.integer,
+                                       g_i2s_tagged_divider.fraction);
+            g_i2s_tagged_buffer = nullptr;
         }
     }
-
-    *frames_out = frames;
-    *frame_count_out = frame_count;
-    return true;
 }
 
-static bool init_i2s_output(uint32_t sample_rate_hz) {
-    if (!g_i2s_initialized) {
-        g_i2s_sm = pio_claim_unused_sm(g_i2s_pio, false);
-        if (g_i2s_sm < 0) {
-            printf("No free PIO state machine for I2S\n");
-            return false;
-        }
+// Starts continuous output on the calling core, beginning with silence until the
+// first rendered buffers arrive. The IRQ runs on this core too.
+static bool i2s_start_buffered(uint32_t sample_rate_hz) {
+    if (g_i2s_streaming) {
+        return true;
+    }
+
+    if (!init_i2s_output(sample_rate_hz)) {
+        return false;
+    }
 
-        g_i2s_dma_channel = dma_claim_unused_channel(false);
-        if (g_i2s_dma_channel < 0) {
-            printf("No free DMA channel for I2S\n");
-            pio_sm_unclaim(g_i2s_pio, static_cast<uint>(g_i2s_sm));
-            g_i2s_sm = -1;
+    for (uint half = 0u; half < 2u; ++half) {
+        g_i2s_chain_dma[half] = dma_claim_unused_channel(false);
+        if (g_i2s_chain_dma[half] < 0) {
+            printf("No free DMA channel for I2S output\n");
+            if (half == 1u) {
+                dma_channel_unclaim(static_cast<uint>(g_i2s_chain_dma[0]));
+                g_i2s_chain_dma[0] = -1;
+            }
             return false;
         }
+    }
 
-        gpio_set_function(I2S_DIN_PIN, GPIO_FUNC_PIO0);
-        gpio_set_function(I2S_BCLK_PIN, GPIO_FUNC_PIO0);
-        gpio_set_function(I2S_LRCLK_PIN, GPIO_FUNC_PIO0);
-
-        g_i2s_program_offset = pio_add_program(g_i2s_pio, &audio_i2s_swapped_program);
-        audio_i2s_swapped_program_init(g_i2s_pio, static_cast<uint>(g_i2s_sm), g_i2s_program_offset, I2S_DIN_PIN, I2S_BCLK_PIN);
+    audio_buffer_pool_init(&g_i2s_pool, g_i2s_buffers, g_i2s_buffer_frames, I2S_BUFFER_COUNT, MIXER_BLOCK_FRAMES,
+                           I2S_FRAME_WORDS);
 
-        dma_channel_config dma_config = dma_channel_get_default_config(static_cast<uint>(g_i2s_dma_channel));
+    for (uint half = 0u; half < 2u; ++half) {
+        const uint channel = static_cast<uint>(g_i2s_chain_dma[half]);
+        dma_channel_config dma_config = dma_channel_get_default_config(channel);
         channel_config_set_dreq(&dma_config, pio_get_dreq(g_i2s_pio, static_cast<uint>(g_i2s_sm), true));
         channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_32);
         channel_config_set_read_increment(&dma_config, true);
         channel_config_set_write_increment(&dma_config, false);
+        channel_config_set_chain_to(&dma_config, static_cast<uint>(g_i2s_chain_dma[half ^ 1u]));
         dma_channel_configure(
-            static_cast<uint>(g_i2s_dma_channel),
+            channel,
             &dma_config,
             &g_i2s_pio->txf[g_i2s_sm],
-            nullptr,
-            0,
+            g_i2s_silence,
+            MIXER_BLOCK_FRAMES * I2S_FRAME_WORDS,
             false
         );
+        dma_channel_set_irq1_enabled(channel, true);
+    }
 
-        g_i2s_initialized = true;
+    g_i2s_streaming = true;
+    irq_add_shared_handler(I2S_DMA_IRQ, i2s_chain_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(I2S_DMA_IRQ, true);
+
+    i2s_start();
+    dma_channel_start(static_cast<uint>(g_i2s_chain_dma[0]));
+    return true;
+}
+
+// Producer side of the output pool: waits (in __wfe) for a free buffer, renders a
+// block into it and queues it for the DMA IRQ.
+static void i2s_render_next_buffer(i2s_render_callback_t render) {
+    audio_buffer_t *buffer = get_free_audio_buffer(&g_i2s_pool, true);
+    render(buffer->frames, buffer->frame_count);
+
+    // A rate change made up to and during this render applies from this buffer on,
+    // unless the previous change has yet to reach the output.
+    if (g_i2s_divider_pending && !g_i2s_tagged_buffer) {
+        g_i2s_tagged_divider = g_i2s_pending_divider;
+        g_i2s_divider_pending = false;
+        __dmb();
+        g_i2s_tagged_buffer = buffer;
     }
+    queue_full_audio_buffer(&g_i2s_pool, buffer);
+}
 
-    if (g_i2s_sample_rate_hz != sample_rate_hz) {
-        const uint32_t system_clock_hz = clock_get_hz(clk_sys);
-        const uint32_t divider = system_clock_hz * 4u / sample_rate_hz;
-        pio_sm_set_clkdiv_int_frac(g_i2s_pio, static_cast<uint>(g_i2s_sm), divider >> 8u, divider & 0xffu);
-        g_i2s_sample_rate_hz = sample_rate_hz;
+// Changes the output rate. While streaming, the DMA chain keeps running and the new
+// rate starts with the buffer being rendered.
+static bool i2s_set_sample_rate(uint32_t sample_rate_hz) {
+    if (!g_i2s_streaming) {
+        return init_i2s_output(sample_rate_hz);
+    }
+    if (sample_rate_hz == g_i2s_sample_rate_hz) {
+        return true;
     }
 
+    i2s_clock_divider_t divider;
+    if (!compute_i2s_divider(sample_rate_hz, &divider)) {
+        return false;
+    }
+    g_i2s_pending_divider = divider;
+    g_i2s_divider_pending = true;
+    g_i2s_sample_rate_hz = sample_rate_hz;
     return true;
 }
 
-bool play_wav(const std::string &filename) {
-    wav_sample_t sample;
-    uint32_t *frames = nullptr;
-    size_t frame_count = 0u;
+// Decoded samples stay resident up to this budget so repeated notes play from SRAM.
+#define SAMPLE_CACHE_BUDGET_BYTES (256u * 1024u)
 
-    if (!load_wav(filename, &sample)) {
-        return false;
+// Level of the summed voices, applied once before the mix is cut to the output width,
+// and whether TPDF dither is added there. Voices themselves play at unity.
+#define MIX_OUTPUT_GAIN (VOICE_GAIN_UNITY / 2u)
+#define MIX_OUTPUT_DITHER true
+
+// Post-mix effects (see effects.h). Each one in use takes core 1 time that voices
+// could otherwise have; its cost is reported with the other statistics.
+#define EFFECT_FILTER_ENABLED false
+#define EFFECT_DELAY_ENABLED false
+#define EFFECT_REVERB_ENABLED false
+
+// Which sounding voice a note-on takes once all MIXER_VOICE_COUNT are busy.
+#define VOICE_STEAL_POLICY VOICE_STEAL_QUIETEST
+
+// Set to 1 to switch the output to a sample's own rate when it starts with nothing
+// else sounding, so it plays without resampling. Off by default: many DACs mute
+// briefly while they relock to a new rate.
+#define I2S_FOLLOW_SAMPLE_RATE 0
+
+// Set to 1 to time the mixer render paths on core 1 before audio output starts.
+#define RUN_AUDIO_BENCHMARKS 0
+
+// Frames read per preloader step on core 0, between polls of the CAN bus.
+#define PRELOAD_CHUNK_FRAMES 512u
+
+static const sample_cache_loader_t k_sample_loader = {
+    open_cached_sample,
+    read_cached_sample,
+    seek_cached_sample,
+    close_cached_sample,
+};
+
+static void release_cached_sample(const void *owner) {
+    sample_cache_release(static_cast<const sample_cache_entry_t *>(owner));
+}
+
+// Key events received on core 0, consumed by the renderer on core 1.
+static note_event_queue_t g_note_events;
+
+static uint32_t g_output_rate_hz = 0u;
+
+// Render timeline: events are scheduled g_note_event_latency_us after they were
+// received, which keeps their spacing exact at the cost of a fixed delay. The
+// delay covers every block the producer can render ahead of playback, plus one.
+static uint32_t g_note_event_latency_us = 0u;
+static uint32_t g_timeline_start_us = 0u;
+static uint64_t g_rendered_frames = 0u;
+
+// Notes whose sample is not in the cache yet wait here while core 0 starts loading
+// it, then stream from the entry as it fills. The timeout only runs while the zone
+// is neither loading nor waiting to; a note whose zone failed is dropped.
+#define PENDING_NOTE_COUNT 4
+#define PENDING_NOTE_TIMEOUT_MS 370u
+
+typedef struct pending_note {
+    uint8_t note;
+    uint8_t velocity;
+    uint32_t blocks_left;  // 0 when the slot is free.
+} pending_note_t;
+
+static pending_note_t g_pending_notes[PENDING_NOTE_COUNT];
+static uint32_t g_pending_notes_lost = 0u;  // Slots full or timed out.
+
+// How often core 1 prints its statistics.
+#define STATS_INTERVAL_MS 10000u
+
+// Render blocks per second at the rate the I2S divider really gives, and the block
+// counts derived from it. Set by set_output_rate().
+static uint32_t g_blocks_per_second = 0u;
+static uint32_t g_pending_note_timeout_blocks = 0u;
+static uint32_t g_stats_interval_blocks = 0u;
+
+static uint32_t blocks_for_ms(uint32_t ms) {
+    const uint32_t blocks = static_cast<uint32_t>(static_cast<uint64_t>(ms) * g_blocks_per_second / 1000u);
+    return blocks > 0u ? blocks : 1u;
+}
+
+// Sets everything on core 1 that depends on the output rate. The timeline is
+// rebased so the frames already rendered keep the duration they had.
+static void set_output_rate(uint32_t sample_rate_hz) {
+    if (g_output_rate_hz != 0u) {
+        g_timeline_start_us += static_cast<uint32_t>(g_rendered_frames * 1000000u / g_output_rate_hz);
+        g_rendered_frames = 0u;
     }
 
-    if (!build_i2s_frames(sample, &frames, &frame_count)) {
-        printf("Failed to build I2S frames for %s\n", filename.c_str());
-        std::free(const_cast<uint8_t *>(sample.data));
-        return false;
+    g_output_rate_hz = sample_rate_hz;
+    g_note_event_latency_us =
+        static_cast<uint32_t>((I2S_BUFFER_COUNT + 1u) * MIXER_BLOCK_FRAMES * 1000000ull / sample_rate_hz);
+
+    // Piano-like shape: quick attack, a long decay to a soft sustain, short release.
+    envelope_config_t envelope;
+    envelope_config_init(&envelope, 10u, 800u, VOICE_GAIN_UNITY / 3u, 250u, sample_rate_hz, MIXER_BLOCK_FRAMES);
+    voice_mixer_set_envelope(&envelope);
+    effects_set_sample_rate(sample_rate_hz);
+
+    i2s_clock_divider_t divider;
+    const uint64_t achieved_mhz =
+        i2s_clock_divider(clock_get_hz(clk_sys), sample_rate_hz, I2S_PIO_CYCLES_PER_FRAME, &divider)
+            ? divider.achieved_mhz
+            : sample_rate_hz * 1000ull;
+    g_blocks_per_second = static_cast<uint32_t>(achieved_mhz / (1000u * MIXER_BLOCK_FRAMES));
+    g_pending_note_timeout_blocks = blocks_for_ms(PENDING_NOTE_TIMEOUT_MS);
+    g_stats_interval_blocks = blocks_for_ms(STATS_INTERVAL_MS);
+}
+
+// Sets up the effects chain with every effect bypassed unless enabled above.
+static void init_effects() {
+    if (!effects_init()) {
+        printf("Out of memory for effects\n");
+        return;
     }
 
-    if (!init_i2s_output(sample.sample_rate_hz)) {
-        std::free(frames);
-        std::free(const_cast<uint8_t *>(sample.data));
-        return false;
+    // A gentle top-end roll-off, a short slapback bouncing between the sides, and a
+    // medium room.
+    effects_set_filter(EFFECTS_FILTER_LOWPASS, 8000u, 707u);
+    effects_set_delay(180u, VOICE_GAIN_UNITY / 3u, VOICE_GAIN_UNITY / 4u, true);
+    effects_set_reverb(VOICE_GAIN_UNITY / 2u, VOICE_GAIN_UNITY / 2u, VOICE_GAIN_UNITY / 3u);
+    effects_set_bypass(EFFECT_FILTER, !EFFECT_FILTER_ENABLED);
+    effects_set_bypass(EFFECT_DELAY, !EFFECT_DELAY_ENABLED);
+    effects_set_bypass(EFFECT_REVERB, !EFFECT_REVERB_ENABLED);
+    voice_mixer_set_bus_callback(effects_process);
+}
+
+// Core cycles each effect in use has averaged per frame since the last report, and
+// the share of core 1 that is at the output rate.
+static void print_effect_stats() {
+    const uint64_t sys_hz = clock_get_hz(clk_sys);
+    for (uint32_t i = 0; i < EFFECT_COUNT; ++i) {
+        const effect_id_t effect = static_cast<effect_id_t>(i);
+        const effects_stats_t stats = effects_get_stats(effect);
+        if (effects_bypassed(effect) || stats.frames == 0u) {
+            continue;
+        }
+
+        const uint64_t cycles_x100 = stats.busy_us * sys_hz / 10000u / stats.frames;
+        const uint64_t load_x1000 = cycles_x100 * g_output_rate_hz * 10u / sys_hz;
+        printf("Effect %-6s %3lu.%02lu cycles per frame, %lu.%lu%% of core 1\n", effects_name(effect),
+               static_cast<unsigned long>(cycles_x100 / 100u), static_cast<unsigned long>(cycles_x100 % 100u),
+               static_cast<unsigned long>(load_x1000 / 10u), static_cast<unsigned long>(load_x1000 % 10u));
     }
+    effects_reset_stats();
+}
 
-    pio_sm_set_enabled(g_i2s_pio, static_cast<uint>(g_i2s_sm), false);
-    pio_sm_clear_fifos(g_i2s_pio, static_cast<uint>(g_i2s_sm));
-    pio_sm_restart(g_i2s_pio, static_cast<uint>(g_i2s_sm));
-    pio_sm_set_enabled(g_i2s_pio, static_cast<uint>(g_i2s_sm), true);
+// A synth zone loops one cycle of its waveform's table for the note's pitch. It
+// plays at concert pitch, so the zone's root is ignored and only its cents apply.
+static void start_synth_note(uint8_t note, uint8_t velocity, uint32_t block_offset, const keymap_zone_t *zone,
+                             wavetable_waveform_t waveform) {
+    const uint32_t step = voice_pitch_step(static_cast<int32_t>(note) - static_cast<int32_t>(WAVETABLE_ROOT_NOTE),
+                                           WAVETABLE_SAMPLE_RATE_HZ, g_output_rate_hz);
+    voice_params_t params = {};
+    params.pitch_step = static_cast<uint32_t>(static_cast<uint64_t>(step) * zone->tune_q16 >> 16u);
+    params.data = wavetable_table(waveform, params.pitch_step);
+    if (!params.data) {
+        return;
+    }
 
-    dma_channel_transfer_from_buffer_now(static_cast<uint>(g_i2s_dma_channel), frames, frame_count);
-    dma_channel_wait_for_finish_blocking(static_cast<uint>(g_i2s_dma_channel));
+    params.encoding = SAMPLE_ENCODING_FRAMES;
+    params.frame_count = WAVETABLE_FRAMES;
+    params.loop_start = 0u;
+    params.loop_end = WAVETABLE_FRAMES;
+    params.gain = VOICE_GAIN_UNITY;
+    params.velocity = velocity;
+    params.block_offset = block_offset;
+    voice_mixer_note_on(note, &params);
+}
 
-    static const uint32_t silence_frames[8] = {0};
-    dma_channel_transfer_from_buffer_now(static_cast<uint>(g_i2s_dma_channel), silence_frames, count_of(silence_frames));
-    dma_channel_wait_for_finish_blocking(static_cast<uint>(g_i2s_dma_channel));
+// Returns false if the key's sample is not cached yet (a load has been requested).
+// A zone that failed to load plays nothing.
+static bool start_note(uint8_t note, uint8_t velocity, uint32_t block_offset) {
+    const keymap_zone_t *zone = keymap_lookup(note, velocity);
+    if (!zone) {
+        return true;
+    }
 
-    while (!pio_sm_is_tx_fifo_empty(g_i2s_pio, static_cast<uint>(g_i2s_sm))) {
-        tight_loop_contents();
+    wavetable_waveform_t waveform;
+    if (wavetable_parse_path(zone->path, &waveform)) {
+        start_synth_note(note, velocity, block_offset, zone, waveform);
+        return true;
     }
 
-    sleep_ms(1);
-    pio_sm_set_enabled(g_i2s_pio, static_cast<uint>(g_i2s_sm), false);
+    const sample_cache_entry_t *entry = sample_cache_acquire(zone->path);
+    if (!entry) {
+        if (preloader_zone_failed(zone)) {
+            return true;
+        }
+        preloader_request(zone);
+        return false;
+    }
+
+    if (I2S_FOLLOW_SAMPLE_RATE && entry->sample_rate_hz != g_output_rate_hz && voice_mixer_active_count() == 0u &&
+        i2s_set_sample_rate(entry->sample_rate_hz)) {
+        set_output_rate(entry->sample_rate_hz);
+    }
 
-    std::free(frames);
-    std::free(const_cast<uint8_t *>(sample.data));
+    const uint32_t step = voice_pitch_step(static_cast<int32_t>(note) - zone->root_note, entry->sample_rate_hz,
+                                           g_output_rate_hz);
+    voice_params_t params = {};
+    params.data = entry->data;
+    params.encoding = entry->encoding;
+    params.frame_count = entry->frame_count;
+    params.frames_ready = &entry->frames_ready;
+    params.loop_start = entry->loop_start;
+    params.loop_end = entry->loop_end;
+    params.gain = VOICE_GAIN_UNITY;
+    params.velocity = velocity;
+    params.pitch_step = static_cast<uint32_t>(static_cast<uint64_t>(step) * zone->tune_q16 >> 16u);
+    params.block_offset = block_offset;
+    params.owner = entry;
+    if (voice_mixer_note_on(note, &params) < 0) {
+        sample_cache_release(entry);
+    }
     return true;
 }
 
-// Copied from sd card implementatino, modified to support WAV files
-int read_sd()
-{
-    FATFS fs;
-    DIR dir;
-    FILINFO file_info;
-
-    f_mount(&fs, "0:", 0);
-
-    FRESULT fr = f_opendir(&dir, "/");
-    if (fr != FR_OK) {
-        uart_puts(UART_ID, "Error opening directory!\n");
-        return 0;
-    }   
-    while (true)
-    {
-        fr = f_readdir(&dir, &file_info);
-        if (fr != FR_OK) {
-            uart_puts(UART_ID, "Error reading directory!\n");
-            return 0;
+static void defer_note(uint8_t note, uint8_t velocity) {
+    for (pending_note_t &pending : g_pending_notes) {
+        if (pending.blocks_left == 0u || pending.note == note) {
+            pending.note = note;
+            pending.velocity = velocity;
+            pending.blocks_left = g_pending_note_timeout_blocks;
+            return;
+        }
+    }
+    ++g_pending_notes_lost;
+}
+
+static void cancel_pending_note(uint8_t note) {
+    for (pending_note_t &pending : g_pending_notes) {
+        if (pending.blocks_left != 0u && pending.note == note) {
+            pending.blocks_left = 0u;
+        }
+    }
+}
+
+static void retry_pending_notes() {
+    for (pending_note_t &pending : g_pending_notes) {
+        if (pending.blocks_left == 0u) {
+            continue;
         }
-        if (file_info.fname[0] == 0) {
+        if (start_note(pending.note, pending.velocity, 0u)) {
+            pending.blocks_left = 0u;
+        } else if (!preloader_zone_loading(keymap_lookup(pending.note, pending.velocity)) &&
+                   --pending.blocks_left == 0u) {
+            ++g_pending_notes_lost;
+        }
+    }
+}
+
+// Applies every queued event that falls inside the block about to be rendered at
+// its frame offset. Later events stay queued; late ones play at offset 0.
+static void apply_note_events(uint32_t frame_count) {
+    uint32_t block_start_us =
+        g_timeline_start_us + static_cast<uint32_t>(g_rendered_frames * 1000000u / g_output_rate_hz);
+
+    // After an underrun the renderer is behind real time; rebase rather than play
+    // every following event late.
+    const int32_t behind_us = static_cast<int32_t>(time_us_32() - block_start_us);
+    if (behind_us > 0) {
+        g_timeline_start_us += static_cast<uint32_t>(behind_us);
+        block_start_us += static_cast<uint32_t>(behind_us);
+    }
+
+    retry_pending_notes();
+
+    const uint32_t block_us = static_cast<uint32_t>(static_cast<uint64_t>(frame_count) * 1000000u / g_output_rate_hz);
+    note_event_t event;
+    while (note_event_queue_peek(&g_note_events, &event)) {
+        const int32_t delta_us = static_cast<int32_t>(event.time_us + g_note_event_latency_us - block_start_us);
+        if (delta_us >= static_cast<int32_t>(block_us)) {
             break;
         }
-        uart_puts(UART_ID, "File name: ");
-        uart_puts(UART_ID, file_info.fname);
-        uart_puts(UART_ID, "\n");
+
+        const uint32_t offset =
+            delta_us > 0 ? static_cast<uint32_t>(static_cast<uint64_t>(delta_us) * g_output_rate_hz / 1000000u) : 0u;
+        if (event.type == NOTE_EVENT_ON) {
+            if (!start_note(event.note, event.velocity, offset)) {
+                defer_note(event.note, event.velocity);
+            }
+        } else {
+            cancel_pending_note(event.note);
+            voice_mixer_note_off_at(event.note, offset);
+        }
+        note_event_queue_pop(&g_note_events);
     }
+}
 
-    // char line[100];
-    // FRESULT result = f_open(&file, "dantheman.txt", FA_READ);
+static void render_with_note_events(uint32_t *frames, uint32_t frame_count) {
+    apply_note_events(frame_count);
+    if (I2S_OUTPUT_BITS == 32) {
+        voice_mixer_render_32(frames, frame_count);
+    } else {
+        voice_mixer_render(frames, frame_count);
+    }
+    g_rendered_frames += frame_count;
+}
 
-    // if(result != FR_OK) {
-    //     printf("Failed to read file!\n");
-    //     return 0;
-    // }
+// Reads the zone manifest described in keymap.h and builds the lookup table.
+static bool load_keymap(const char *path) {
+    FIL file;
+    if (f_open(&file, path, FA_READ) != FR_OK) {
+        return false;
+    }
+
+    keymap_clear();
+    char line[96];
+    uint32_t line_number = 0u;
+    while (f_gets(line, sizeof(line), &file)) {
+        ++line_number;
+        keymap_zone_t zone;
+        const keymap_line_t kind = keymap_parse_line(line, &zone);
+        if (kind == KEYMAP_LINE_INVALID) {
+            printf("Ignoring keymap line %lu in %s\n", static_cast<unsigned long>(line_number), path);
+        } else if (kind == KEYMAP_LINE_ZONE && !keymap_add_zone(&zone)) {
+            printf("Keymap %s has more than %u zones\n", path, KEYMAP_MAX_ZONES);
+            break;
+        }
+    }
 
-    // printf("Contents of file:\n");
-    // while (f_gets(line, sizeof(line), &file)) {
-    //     printf("%s", line);
-    // }
+    f_close(&file);
+    if (!keymap_build()) {
+        printf("No usable zones in %s\n", path);
+        return false;
+    }
+    printf("Keymap: %lu zones from %s\n", static_cast<unsigned long>(keymap_zone_count()), path);
+    return true;
+}
+
+// Without a manifest, every key is pitched from the one c4 recording.
+static bool load_single_sample_keymap() {
+    static const char *const c4_paths[] = {"0:/c4.mps", "0:/c4.wav"};
+
+    // Prefer the pre-converted copy written by convert_sample.py.
+    for (const char *path : c4_paths) {
+        FILINFO info;
+        if (f_stat(path, &info) != FR_OK) {
+            continue;
+        }
 
-    printf("\n");
+        keymap_zone_t zone = {};
+        std::strcpy(zone.path, path);
+        zone.low_note = 0u;
+        zone.high_note = 127u;
+        zone.low_velocity = 0u;
+        zone.high_velocity = 127u;
+        zone.root_note = 60u;
+        zone.tune_q16 = 1u << 16u;
+        keymap_clear();
+        keymap_add_zone(&zone);
+        return keymap_build();
+    }
+    return false;
+}
 
-    return 1;
+// Without a card, or nothing playable on it, every key plays one synth waveform.
+static bool load_synth_keymap(const char *path) {
+    keymap_zone_t zone = {};
+    std::strcpy(zone.path, path);
+    zone.low_note = 0u;
+    zone.high_note = 127u;
+    zone.low_velocity = 0u;
+    zone.high_velocity = 127u;
+    zone.root_note = WAVETABLE_ROOT_NOTE;
+    zone.tune_q16 = 1u << 16u;
+    keymap_clear();
+    keymap_add_zone(&zone);
+    return keymap_build();
+}
 
+// The output runs at the rate of the first sample zone; zones recorded at other
+// rates, and synth zones, are resampled by their pitch step. 0 if that sample
+// cannot be read.
+static uint32_t keymap_output_rate() {
+    for (uint32_t i = 0; i < keymap_zone_count(); ++i) {
+        wavetable_waveform_t waveform;
+        if (!wavetable_parse_path(keymap_zone(i)->path, &waveform)) {
+            return probe_sample_rate(keymap_zone(i)->path);
+        }
+    }
+    return I2S_NOMINAL_SAMPLE_RATE_HZ;
 }
 
+#define KEYMAP_PATH "0:/keymap.txt"
+
+// Mount attempts, a second apart, before playing without the card.
+#define SD_MOUNT_ATTEMPTS 3
+
+// What every key plays when there is no usable instrument on the card.
+#define SYNTH_FALLBACK_PATH WAVETABLE_PATH_PREFIX "saw"
+
 void uart_core1() {
-    while(true){
-        // uart_puts(UART_ID, "Hello from core 1!\n");
-        play_wav("0:/c4.wav");
-        uart_puts(UART_ID, "Playing Tone\n");
+    static FATFS fs;
+    uint32_t sample_rate_hz = 0u;
+
+    // Built before the card is touched, so synth voices play whatever state it is in.
+    if (!wavetable_init()) {
+        printf("Out of memory for wavetables\n");
+    }
+
+    bool mounted = false;
+    for (uint32_t attempt = 0; attempt < SD_MOUNT_ATTEMPTS && !mounted; ++attempt) {
+        mounted = f_mount(&fs, "0:", 1) == FR_OK;
+        if (!mounted) {
+            printf("Failed to mount SD card\n");
+            sleep_ms(1000);
+        }
+    }
+
+    if (mounted && (load_keymap(KEYMAP_PATH) || load_single_sample_keymap())) {
+        sample_rate_hz = keymap_output_rate();
+    }
+    if (sample_rate_hz == 0u) {
+        printf("No instrument on the SD card, playing %s\n", SYNTH_FALLBACK_PATH);
+        load_synth_keymap(SYNTH_FALLBACK_PATH);
+        sample_rate_hz = I2S_NOMINAL_SAMPLE_RATE_HZ;
+    }
+
+    // Hand the card to core 0, which preloads the keymap's samples from here on.
+    sample_cache_init(SAMPLE_CACHE_BUDGET_BYTES, &k_sample_loader);
+    preloader_init();
+    multicore_fifo_push_blocking(CORE1_READY_TOKEN);
+
+    if (RUN_AUDIO_BENCHMARKS) {
+        audio_bench_run(sample_rate_hz);
+    }
+
+    voice_mixer_init();
+    voice_mixer_set_release_callback(release_cached_sample);
+    voice_mixer_set_steal_policy(VOICE_STEAL_POLICY);
+    voice_mixer_set_output(MIX_OUTPUT_GAIN, MIX_OUTPUT_DITHER);
+    init_effects();
+    set_output_rate(sample_rate_hz);
+    while (!i2s_start_buffered(sample_rate_hz)) {
         sleep_ms(1000);
     }
+    g_timeline_start_us = time_us_32();
+
+    // Core 1 is the audio producer: it renders whenever the pool has a free buffer,
+    // applying the key events from core 0 just before each block.
+    // Steals are also counted per second of output, to size the voice pool against
+    // the busiest passages rather than the average. Both intervals follow the output
+    // rate as set_output_rate() changes it.
+    uint32_t steals_at_second = 0u;
+    uint32_t peak_steals_per_second = 0u;
+
+    uint32_t block_count = 0u;
+    while (true) {
+        i2s_render_next_buffer(render_with_note_events);
+
+        if (block_count % g_blocks_per_second == 0u) {
+            const uint32_t steals = voice_mixer_get_steal_stats().steals;
+            if (steals - steals_at_second > peak_steals_per_second) {
+                peak_steals_per_second = steals - steals_at_second;
+            }
+            steals_at_second = steals;
+        }
+
+        if (++block_count % g_stats_interval_blocks == 0u) {
+            const sample_cache_stats_t stats = sample_cache_get_stats();
+            printf("Sample cache: %lu hits, %lu misses, %lu evictions, %u/%u bytes, %lu keys ready, %lu notes lost\n",
+                   static_cast<unsigned long>(stats.hits), static_cast<unsigned long>(stats.misses),
+                   static_cast<unsigned long>(stats.evictions), static_cast<unsigned>(stats.bytes_used),
+                   static_cast<unsigned>(stats.budget_bytes), static_cast<unsigned long>(preloader_ready_key_count()),
+                   static_cast<unsigned long>(g_pending_notes_lost));
+
+            const audio_buffer_pool_stats_t pool = audio_buffer_pool_get_stats(&g_i2s_pool);
+            printf("Audio pool: depth %lu (min %lu) of %u, %lu underruns, %lu overruns, %lu dropped key events\n",
+                   static_cast<unsigned long>(pool.depth), static_cast<unsigned long>(pool.min_depth),
+                   I2S_BUFFER_COUNT, static_cast<unsigned long>(pool.underruns),
+                   static_cast<unsigned long>(pool.overruns), static_cast<unsigned long>(g_note_events.dropped));
+            audio_buffer_pool_reset_min_depth(&g_i2s_pool);
+
+            const voice_steal_stats_t steals = voice_mixer_get_steal_stats();
+            printf("Voices: %lu of %u active, %lu steals (%lu unfaded), peak %lu steals/s\n",
+                   static_cast<unsigned long>(voice_mixer_active_count()), MIXER_VOICE_COUNT,
+                   static_cast<unsigned long>(steals.steals), static_cast<unsigned long>(steals.unfaded_steals),
+                   static_cast<unsigned long>(peak_steals_per_second));
+            peak_steals_per_second = 0u;
+            print_effect_stats();
+        }
+    }
+}
+
+// Core 0: turns key frames from the CAN bus into timestamped events for core 1, and
+// preloads samples whenever the bus is quiet. The MCP2515 shares spi0 with the SD
+// card, so each read holds the SD driver's bus lock, set up by sd_init_driver() in
+// main().
+static void can_receive_loop(MCP2515 &mcp2515) {
+    multicore_fifo_pop_blocking();
+    spi_t *bus = spi_get_by_num(0);
+    bool preloading = true;
+
+    while (true) {
+        can_frame frame;
+        spi_lock(bus);
+        const MCP2515::ERROR err = mcp2515.readMessage(&frame);
+        spi_unlock(bus);
+
+        if (err != MCP2515::ERROR_OK) {
+            const bool more = preloader_step(PRELOAD_CHUNK_FRAMES);
+            if (preloading && !more) {
+                printf("Preload finished after %lu ms: %lu keys ready\n",
+                       static_cast<unsigned long>(to_ms_since_boot(get_absolute_time())),
+                       static_cast<unsigned long>(preloader_ready_key_count()));
+            }
+            preloading = more;
+            if (!more) {
+                sleep_us(100);
+            }
+            continue;
+        }
+
+        if ((frame.can_id != CAN_ID_NOTE_ON && frame.can_id != CAN_ID_NOTE_OFF) || frame.can_dlc < 2u) {
+            continue;
+        }
+
+        note_event_t event;
+        event.time_us = time_us_32();
+        event.type = frame.can_id == CAN_ID_NOTE_ON ? NOTE_EVENT_ON : NOTE_EVENT_OFF;
+        event.note = frame.data[0];
+        event.velocity = frame.data[1];
+        note_event_queue_push(&g_note_events, &event);
+    }
+}
+
+// Moves clk_sys to the PLL setting that best suits I2S_NOMINAL_SAMPLE_RATE_HZ. Must
+// run before any peripheral is set up: clk_peri follows clk_sys, so UART, SPI and
+// I2C baud rates set earlier would be off.
+static bool retune_sys_clock_for_i2s(i2s_sys_clock_t *clock) {
+    if (!i2s_clock_find_sys_clock(I2S_NOMINAL_SAMPLE_RATE_HZ, I2S_PIO_CYCLES_PER_FRAME, XOSC_HZ, I2S_SYS_CLOCK_MIN_HZ,
+                                  I2S_SYS_CLOCK_MAX_HZ, clock)) {
+        return false;
+    }
+    set_sys_clock_pll(clock->vco_hz, clock->post_div1, clock->post_div2);
+    return true;
 }
 
 int main()
 {
+    i2s_sys_clock_t i2s_clock;
+    const bool retuned = I2S_RETUNE_SYS_CLOCK && retune_sys_clock_for_i2s(&i2s_clock);
+
     stdio_init_all();
+    if (retuned) {
+        printf("clk_sys retuned to %lu Hz for %lu Hz I2S\n", static_cast<unsigned long>(i2s_clock.sys_clock_hz),
+               static_cast<unsigned long>(I2S_NOMINAL_SAMPLE_RATE_HZ));
+    }
 
 
     // SPI initialisation. This example will use SPI at 1MHz.
@@ -488,10 +1058,20 @@ int main()
     gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
     
     // CAN Bus Initialisation
-    can_init();
+    MCP2515 mcp2515(spi0, CAN_CS, CAN_MOSI, CAN_MISO, CAN_SCK);
+    can_init(mcp2515);
+
+    // The SD driver enables its DMA completion IRQ on the core that initialises it.
+    // Core 0 does the preloading, so it takes those IRQs and core 1's rendering is
+    // not interrupted by them; core 1's mount finds the driver already set up.
+    if (!sd_init_driver()) {
+        printf("Failed to initialise the SD card driver\n");
+    }
 
     // UART Second Core Startup
+    note_event_queue_init(&g_note_events);
     multicore_launch_core1(uart_core1);
+    can_receive_loop(mcp2515);
     
     // For more examples of UART use see https://github.com/raspberrypi/pico-examples/tree/master/uart
     // screen_run();
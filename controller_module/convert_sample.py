@@ -0,0 +1,167 @@
+# Usage: "python convert_sample.py sample.wav [--loop START END] [--adpcm]"
+# outputs: sample.mps, the native sample format described in include/native_sample.h
+# Without --loop, the first loop of the WAV's smpl chunk (if any) is carried over.
+# Copy the .mps file to the SD card; the firmware DMAs its frames without conversion.
+# --adpcm stores IMA-ADPCM blocks instead (see adpcm.h), about a quarter of the size
+# of 16-bit PCM; the firmware keeps them compressed and decodes them as it plays.
+
+import os
+import struct
+import sys
+import wave
+
+MAGIC = b"MPSM"
+VERSION = 1
+DATA_ALIGN = 512
+FLAG_ADPCM = 0x1
+FLAG_MONO = 0x2
+
+ADPCM_BLOCK_FRAMES = 64
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+]
+ADPCM_INDEX_ADJUST = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def pack_i2s_frame(left, right):
+    return ((left & 0xFFFF) << 16) | (right & 0xFFFF)
+
+
+def read_channels(wav):
+    channels = wav.getnchannels()
+    width = wav.getsampwidth()
+    raw = wav.readframes(wav.getnframes())
+
+    if channels not in (1, 2) or width not in (1, 2):
+        raise ValueError(f"unsupported layout: {channels} channel(s), {width * 8}-bit")
+
+    if width == 2:
+        samples = struct.unpack(f"<{len(raw) // 2}h", raw)
+    else:
+        # 8-bit WAV data is unsigned
+        samples = [(b - 128) << 8 for b in raw]
+
+    count = len(samples) // channels
+    return [list(samples[c:count * channels:channels]) for c in range(channels)]
+
+
+def pack_frames(channels):
+    right = channels[-1]
+    return [pack_i2s_frame(left, right[i]) for i, left in enumerate(channels[0])]
+
+
+def adpcm_decode(predictor, index, code):
+    # Must match decode_code() in adpcm.cpp bit for bit.
+    diff = ((code & 7) * 2 + 1) * ADPCM_STEPS[index] >> 3
+    predictor = predictor - diff if code & 8 else predictor + diff
+    predictor = max(-32768, min(32767, predictor))
+    index = max(0, min(88, index + ADPCM_INDEX_ADJUST[code & 7]))
+    return predictor, index
+
+
+def adpcm_encode_block(samples, index):
+    # Returns the channel's header and code bytes for one block, and the step index
+    # to carry into the next block.
+    header = struct.pack("<hBB", samples[0], index, 0)
+    predictor = samples[0]
+    codes = []
+    for sample in samples[1:]:
+        delta = sample - predictor
+        code = min(7, abs(delta) * 4 // ADPCM_STEPS[index])
+        if delta < 0:
+            code |= 8
+        predictor, index = adpcm_decode(predictor, index, code)
+        codes.append(code)
+    codes.append(0)
+    code_bytes = bytes(codes[i] | (codes[i + 1] << 4) for i in range(0, len(codes), 2))
+    return header, code_bytes, index
+
+
+def encode_adpcm(channels):
+    count = len(channels[0])
+    padded = -(-count // ADPCM_BLOCK_FRAMES) * ADPCM_BLOCK_FRAMES
+    channels = [samples + [samples[-1]] * (padded - count) for samples in channels]
+    indices = [0] * len(channels)
+
+    data = bytearray()
+    for start in range(0, padded, ADPCM_BLOCK_FRAMES):
+        headers = b""
+        codes = b""
+        for c, samples in enumerate(channels):
+            header, code_bytes, indices[c] = adpcm_encode_block(samples[start:start + ADPCM_BLOCK_FRAMES], indices[c])
+            headers += header
+            codes += code_bytes
+        data += headers + codes
+    return bytes(data)
+
+
+def read_smpl_loop(path):
+    # The wave module skips smpl, so walk the RIFF chunks directly. The loop end in
+    # the chunk is inclusive; the native format stores it exclusive.
+    with open(path, "rb") as f:
+        data = f.read()
+
+    offset = 12
+    while offset + 8 <= len(data):
+        chunk_id, size = struct.unpack_from("<4sI", data, offset)
+        body = offset + 8
+        if chunk_id == b"smpl" and size >= 60 and struct.unpack_from("<I", data, body + 28)[0] > 0:
+            start, end = struct.unpack_from("<II", data, body + 36 + 8)
+            return start, end + 1
+        offset = body + size + (size & 1)
+    return 0, 0
+
+
+def convert(input_path, output_path, loop_start=0, loop_end=0, adpcm=False):
+    if not os.path.exists(input_path):
+        print(f"cannot find '{input_path}', wrong file name")
+        return
+
+    if not loop_end:
+        loop_start, loop_end = read_smpl_loop(input_path)
+
+    with wave.open(input_path, "rb") as wav:
+        sample_rate = wav.getframerate()
+        channels = read_channels(wav)
+
+    frame_count = len(channels[0])
+    if not frame_count:
+        raise ValueError("sample has no frames")
+    if loop_end and not 0 <= loop_start < loop_end <= frame_count:
+        raise ValueError(f"loop {loop_start}..{loop_end} outside 0..{frame_count}")
+
+    if adpcm:
+        flags = FLAG_ADPCM | (FLAG_MONO if len(channels) == 1 else 0)
+        data = encode_adpcm(channels)
+    else:
+        flags = 0
+        frames = pack_frames(channels)
+        data = struct.pack(f"<{len(frames)}I", *frames)
+
+    header = MAGIC + struct.pack("<HHIIIII", VERSION, DATA_ALIGN, sample_rate, frame_count, loop_start, loop_end, flags)
+    header += bytes(DATA_ALIGN - len(header))
+
+    with open(output_path, "wb") as f:
+        f.write(header)
+        f.write(data)
+
+    loop = f", loop {loop_start}..{loop_end}" if loop_end else ""
+    encoding = f", IMA-ADPCM {len(data)} bytes" if adpcm else ""
+    print(f"{output_path}: {frame_count} frames at {sample_rate} Hz{loop}{encoding}")
+
+
+if __name__ == "__main__":
+    input_file = sys.argv[1]
+    output_file = os.path.splitext(input_file)[0] + ".mps"
+
+    loop = (0, 0)
+    if "--loop" in sys.argv:
+        i = sys.argv.index("--loop")
+        loop = (int(sys.argv[i + 1]), int(sys.argv[i + 2]))
+
+    convert(input_file, output_file, *loop, adpcm="--adpcm" in sys.argv)
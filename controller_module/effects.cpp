@@ -0,0 +1,354 @@
+#include "effects.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "pico/time.h"
+#include "mix_kernels.h"
+
+// Freeverb's tunings at 44.1 kHz, kept in frames at every rate: the room sounds a
+// little smaller at 48 kHz. The right side's lines are longer by the spread, which
+// decorrelates the two sides of the tail.
+#define REVERB_COMB_COUNT 4u
+#define REVERB_ALLPASS_COUNT 2u
+#define REVERB_STEREO_SPREAD 23u
+
+static const uint32_t k_comb_frames[REVERB_COMB_COUNT] = {1116u, 1188u, 1277u, 1356u};
+static const uint32_t k_allpass_frames[REVERB_ALLPASS_COUNT] = {556u, 441u};
+
+#define REVERB_LINE_FRAMES (2u * (1116u + 1188u + 1277u + 1356u + 556u + 441u) + \
+                            (REVERB_COMB_COUNT + REVERB_ALLPASS_COUNT) * REVERB_STEREO_SPREAD)
+
+// Biquad coefficients are Q28 so that |a1| up to 2 fits with headroom; the one-pole's
+// is Q30 so that low cutoffs keep their precision.
+#define FILTER_COEFF_BITS 28
+#define ONE_POLE_COEFF_BITS 30
+
+static const char *const k_effect_names[EFFECT_COUNT] = {"filter", "delay", "reverb"};
+
+typedef struct delay_line {
+    int16_t *samples;
+    uint32_t length;
+    uint32_t index;
+    int32_t store;  // Comb damping filter state; unused by allpasses.
+} delay_line_t;
+
+typedef struct filter_state {
+    effects_filter_type_t type;
+    uint32_t cutoff_hz;
+    uint32_t q_x1000;
+    int32_t b0, b1, b2, a1, a2;  // Q28, a1 and a2 negated into the sum.
+    int32_t one_pole_q30;
+    int32_t x1[2], x2[2], y1[2], y2[2];
+} filter_state_t;
+
+typedef struct delay_state {
+    uint32_t time_ms;
+    uint32_t frames;
+    int32_t feedback_q15;
+    int32_t level_q15;
+    bool cross_feedback;
+    int16_t *line;  // Interleaved left/right, EFFECTS_DELAY_MAX_FRAMES long.
+    uint32_t index;
+} delay_state_t;
+
+typedef struct reverb_state {
+    int32_t feedback_q15;
+    int32_t damping_q15;
+    int32_t level_q15;
+    delay_line_t combs[2][REVERB_COMB_COUNT];
+    delay_line_t allpasses[2][REVERB_ALLPASS_COUNT];
+} reverb_state_t;
+
+static filter_state_t g_filter;
+static delay_state_t g_delay;
+static reverb_state_t g_reverb;
+static int16_t *g_lines = nullptr;
+static uint32_t g_sample_rate_hz = 44100u;
+static bool g_bypass[EFFECT_COUNT] = {true, true, true};
+static effects_stats_t g_stats[EFFECT_COUNT];
+
+static inline int32_t saturate_s16(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+}
+
+static inline int32_t saturate_s32(int64_t value) {
+    return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : static_cast<int32_t>(value));
+}
+
+static int32_t to_fixed(double value, int bits) {
+    return static_cast<int32_t>(std::lround(value * static_cast<double>(1 << bits)));
+}
+
+static void update_filter() {
+    const double nyquist_guard = 0.45 * g_sample_rate_hz;
+    double cutoff = g_filter.cutoff_hz < 10u ? 10.0 : static_cast<double>(g_filter.cutoff_hz);
+    cutoff = cutoff > nyquist_guard ? nyquist_guard : cutoff;
+    const double w0 = 2.0 * M_PI * cutoff / g_sample_rate_hz;
+
+    g_filter.one_pole_q30 = to_fixed(1.0 - std::exp(-w0), ONE_POLE_COEFF_BITS);
+
+    // RBJ cookbook biquads.
+    const double q = g_filter.q_x1000 < 100u ? 0.1 : g_filter.q_x1000 / 1000.0;
+    const double alpha = std::sin(w0) / (2.0 * q);
+    const double cos_w0 = std::cos(w0);
+    const double a0 = 1.0 + alpha;
+    const double b1 = g_filter.type == EFFECTS_FILTER_HIGHPASS ? -(1.0 + cos_w0) : 1.0 - cos_w0;
+    const double b0 = std::fabs(b1) / 2.0;
+    g_filter.b0 = to_fixed(b0 / a0, FILTER_COEFF_BITS);
+    g_filter.b1 = to_fixed(b1 / a0, FILTER_COEFF_BITS);
+    g_filter.b2 = g_filter.b0;
+    g_filter.a1 = to_fixed(2.0 * cos_w0 / a0, FILTER_COEFF_BITS);
+    g_filter.a2 = to_fixed(-(1.0 - alpha) / a0, FILTER_COEFF_BITS);
+}
+
+static void update_delay() {
+    const uint64_t frames = static_cast<uint64_t>(g_delay.time_ms) * g_sample_rate_hz / 1000u;
+    g_delay.frames = frames < 1u ? 1u : (frames > EFFECTS_DELAY_MAX_FRAMES ? EFFECTS_DELAY_MAX_FRAMES
+                                                                            : static_cast<uint32_t>(frames));
+}
+
+static void clear_state(effect_id_t effect) {
+    switch (effect) {
+    case EFFECT_FILTER:
+        std::memset(g_filter.x1, 0, sizeof(g_filter.x1));
+        std::memset(g_filter.x2, 0, sizeof(g_filter.x2));
+        std::memset(g_filter.y1, 0, sizeof(g_filter.y1));
+        std::memset(g_filter.y2, 0, sizeof(g_filter.y2));
+        break;
+    case EFFECT_DELAY:
+        std::memset(g_delay.line, 0, EFFECTS_DELAY_MAX_FRAMES * 2u * sizeof(int16_t));
+        g_delay.index = 0u;
+        break;
+    default:
+        for (uint32_t side = 0; side < 2u; ++side) {
+            for (delay_line_t &comb : g_reverb.combs[side]) {
+                std::memset(comb.samples, 0, comb.length * sizeof(int16_t));
+                comb.index = 0u;
+                comb.store = 0;
+            }
+            for (delay_line_t &allpass : g_reverb.allpasses[side]) {
+                std::memset(allpass.samples, 0, allpass.length * sizeof(int16_t));
+                allpass.index = 0u;
+            }
+        }
+        break;
+    }
+}
+
+bool effects_init() {
+    if (!g_lines) {
+        g_lines = static_cast<int16_t *>(
+            std::malloc((EFFECTS_DELAY_MAX_FRAMES * 2u + REVERB_LINE_FRAMES) * sizeof(int16_t)));
+        if (!g_lines) {
+            return false;
+        }
+    }
+
+    g_delay.line = g_lines;
+    int16_t *next = g_lines + EFFECTS_DELAY_MAX_FRAMES * 2u;
+    for (uint32_t side = 0; side < 2u; ++side) {
+        const uint32_t spread = side * REVERB_STEREO_SPREAD;
+        for (uint32_t i = 0; i < REVERB_COMB_COUNT; ++i) {
+            g_reverb.combs[side][i].samples = next;
+            g_reverb.combs[side][i].length = k_comb_frames[i] + spread;
+            next += g_reverb.combs[side][i].length;
+        }
+        for (uint32_t i = 0; i < REVERB_ALLPASS_COUNT; ++i) {
+            g_reverb.allpasses[side][i].samples = next;
+            g_reverb.allpasses[side][i].length = k_allpass_frames[i] + spread;
+            next += g_reverb.allpasses[side][i].length;
+        }
+    }
+
+    for (uint32_t effect = 0; effect < EFFECT_COUNT; ++effect) {
+        g_bypass[effect] = true;
+        clear_state(static_cast<effect_id_t>(effect));
+    }
+    effects_reset_stats();
+    return true;
+}
+
+void effects_set_sample_rate(uint32_t sample_rate_hz) {
+    g_sample_rate_hz = sample_rate_hz;
+    update_filter();
+    update_delay();
+}
+
+void effects_set_filter(effects_filter_type_t type, uint32_t cutoff_hz, uint32_t q_x1000) {
+    g_filter.type = type;
+    g_filter.cutoff_hz = cutoff_hz;
+    g_filter.q_x1000 = q_x1000;
+    update_filter();
+}
+
+void effects_set_delay(uint32_t time_ms, uint16_t feedback_q15, uint16_t level_q15, bool cross_feedback) {
+    g_delay.time_ms = time_ms;
+    // Feedback stops short of unity so repeats always die away.
+    g_delay.feedback_q15 = feedback_q15 > 0x7800u ? 0x7800 : feedback_q15;
+    g_delay.level_q15 = level_q15 > 0x8000u ? 0x8000 : level_q15;
+    g_delay.cross_feedback = cross_feedback;
+    update_delay();
+}
+
+void effects_set_reverb(uint16_t room_q15, uint16_t damping_q15, uint16_t level_q15) {
+    // Freeverb's scaling: comb feedback 0.7 to 0.98, damping up to 0.4.
+    const int32_t room = room_q15 > 0x8000u ? 0x8000 : room_q15;
+    const int32_t damping = damping_q15 > 0x8000u ? 0x8000 : damping_q15;
+    g_reverb.feedback_q15 = 22938 + ((room * 9175) >> 15);
+    g_reverb.damping_q15 = (damping * 13107) >> 15;
+    g_reverb.level_q15 = level_q15 > 0x8000u ? 0x8000 : level_q15;
+}
+
+void effects_set_bypass(effect_id_t effect, bool bypass) {
+    if (effect >= EFFECT_COUNT || (!bypass && !g_lines)) {
+        return;
+    }
+    if (g_bypass[effect] && !bypass) {
+        clear_state(effect);
+    }
+    g_bypass[effect] = bypass;
+}
+
+bool effects_bypassed(effect_id_t effect) {
+    return effect >= EFFECT_COUNT || g_bypass[effect];
+}
+
+static void process_filter(int32_t *bus, uint32_t frame_count) {
+    if (g_filter.type == EFFECTS_FILTER_ONE_POLE_LOWPASS) {
+        const int64_t coeff = g_filter.one_pole_q30;
+        for (uint32_t side = 0; side < 2u; ++side) {
+            int32_t y = g_filter.y1[side];
+            for (uint32_t i = side; i < frame_count * 2u; i += 2u) {
+                y += static_cast<int32_t>((static_cast<int64_t>(bus[i]) - y) * coeff >> ONE_POLE_COEFF_BITS);
+                bus[i] = y;
+            }
+            g_filter.y1[side] = y;
+        }
+        return;
+    }
+
+    // Direct form I: the state holds the bus values themselves, so the feedback
+    // path keeps the full precision of the bus.
+    for (uint32_t side = 0; side < 2u; ++side) {
+        int32_t x1 = g_filter.x1[side];
+        int32_t x2 = g_filter.x2[side];
+        int32_t y1 = g_filter.y1[side];
+        int32_t y2 = g_filter.y2[side];
+        for (uint32_t i = side; i < frame_count * 2u; i += 2u) {
+            const int32_t x = bus[i];
+            const int64_t sum = static_cast<int64_t>(g_filter.b0) * x + static_cast<int64_t>(g_filter.b1) * x1 +
+                                static_cast<int64_t>(g_filter.b2) * x2 + static_cast<int64_t>(g_filter.a1) * y1 +
+                                static_cast<int64_t>(g_filter.a2) * y2;
+            const int32_t y = saturate_s32((sum + (1 << (FILTER_COEFF_BITS - 1))) >> FILTER_COEFF_BITS);
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            bus[i] = y;
+        }
+        g_filter.x1[side] = x1;
+        g_filter.x2[side] = x2;
+        g_filter.y1[side] = y1;
+        g_filter.y2[side] = y2;
+    }
+}
+
+static void process_delay(int32_t *bus, uint32_t frame_count) {
+    int16_t *line = g_delay.line;
+    uint32_t index = g_delay.index;
+    uint32_t read = index >= g_delay.frames ? index - g_delay.frames : index + EFFECTS_DELAY_MAX_FRAMES - g_delay.frames;
+    const int32_t feedback = g_delay.feedback_q15;
+    const int32_t level = g_delay.level_q15;
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        const int32_t echo_left = line[read * 2u];
+        const int32_t echo_right = line[read * 2u + 1u];
+        const int32_t in_left = bus[i * 2u] >> MIX_BUS_FRAC_BITS;
+        const int32_t in_right = bus[i * 2u + 1u] >> MIX_BUS_FRAC_BITS;
+        const int32_t back_left = g_delay.cross_feedback ? echo_right : echo_left;
+        const int32_t back_right = g_delay.cross_feedback ? echo_left : echo_right;
+
+        line[index * 2u] = static_cast<int16_t>(saturate_s16(in_left + ((back_left * feedback) >> 15)));
+        line[index * 2u + 1u] = static_cast<int16_t>(saturate_s16(in_right + ((back_right * feedback) >> 15)));
+        bus[i * 2u] += (echo_left * level) >> (15 - MIX_BUS_FRAC_BITS);
+        bus[i * 2u + 1u] += (echo_right * level) >> (15 - MIX_BUS_FRAC_BITS);
+
+        index = index + 1u == EFFECTS_DELAY_MAX_FRAMES ? 0u : index + 1u;
+        read = read + 1u == EFFECTS_DELAY_MAX_FRAMES ? 0u : read + 1u;
+    }
+    g_delay.index = index;
+}
+
+static inline int32_t process_comb(delay_line_t *comb, int32_t input, int32_t feedback, int32_t damping) {
+    const int32_t output = comb->samples[comb->index];
+    comb->store = (output * (32768 - damping) + comb->store * damping) >> 15;
+    comb->samples[comb->index] = static_cast<int16_t>(saturate_s16(input + ((comb->store * feedback) >> 15)));
+    comb->index = comb->index + 1u == comb->length ? 0u : comb->index + 1u;
+    return output;
+}
+
+static inline int32_t process_allpass(delay_line_t *allpass, int32_t input) {
+    const int32_t delayed = allpass->samples[allpass->index];
+    allpass->samples[allpass->index] = static_cast<int16_t>(saturate_s16(input + (delayed >> 1)));
+    allpass->index = allpass->index + 1u == allpass->length ? 0u : allpass->index + 1u;
+    return delayed - input;
+}
+
+static void process_reverb(int32_t *bus, uint32_t frame_count) {
+    const int32_t feedback = g_reverb.feedback_q15;
+    const int32_t damping = g_reverb.damping_q15;
+    const int32_t level = g_reverb.level_q15;
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        // Mono send at a quarter of the 16-bit scale, so a loud low note held in a
+        // long room stays clear of the lines' range.
+        const int32_t input = (bus[i * 2u] + bus[i * 2u + 1u]) >> (MIX_BUS_FRAC_BITS + 3);
+        for (uint32_t side = 0; side < 2u; ++side) {
+            int32_t wet = 0;
+            for (delay_line_t &comb : g_reverb.combs[side]) {
+                wet += process_comb(&comb, input, feedback, damping);
+            }
+            wet >>= 2;
+            for (delay_line_t &allpass : g_reverb.allpasses[side]) {
+                wet = process_allpass(&allpass, wet);
+            }
+            bus[i * 2u + side] += (saturate_s16(wet) * level) >> (15 - MIX_BUS_FRAC_BITS);
+        }
+    }
+}
+
+typedef void (*effect_process_t)(int32_t *bus, uint32_t frame_count);
+
+static const effect_process_t k_effect_process[EFFECT_COUNT] = {process_filter, process_delay, process_reverb};
+
+void effects_process(int32_t *bus, uint32_t frame_count) {
+    for (uint32_t effect = 0; effect < EFFECT_COUNT; ++effect) {
+        if (g_bypass[effect]) {
+            continue;
+        }
+
+        const uint32_t start_us = time_us_32();
+        k_effect_process[effect](bus, frame_count);
+        effects_stats_t &stats = g_stats[effect];
+        stats.busy_us += time_us_32() - start_us;
+        stats.frames += frame_count;
+        ++stats.blocks;
+    }
+}
+
+const char *effects_name(effect_id_t effect) {
+    return effect < EFFECT_COUNT ? k_effect_names[effect] : "?";
+}
+
+effects_stats_t effects_get_stats(effect_id_t effect) {
+    if (effect >= EFFECT_COUNT) {
+        return effects_stats_t{};
+    }
+    return g_stats[effect];
+}
+
+void effects_reset_stats() {
+    std::memset(g_stats, 0, sizeof(g_stats));
+}
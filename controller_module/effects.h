@@ -0,0 +1,68 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Post-mix effects chain, run in place on the mix bus (see mix_kernels.h) once per
+// block, between the voices and the output stage: filter, then delay, then reverb.
+// Everything is fixed-point. The filter is an insert; the delay and reverb add
+// their wet signal to the dry mix, and keep their lines as 16-bit samples to halve
+// the RAM they need.
+//
+// Each effect can be bypassed, which skips it entirely, and the time each one
+// spends processing is accumulated so its cost can be weighed against voices.
+// All effects start bypassed.
+#define EFFECTS_DELAY_MAX_FRAMES 11025u  // 250 ms at 44.1 kHz; 44 KB of line.
+
+typedef enum effect_id {
+    EFFECT_FILTER = 0,
+    EFFECT_DELAY,
+    EFFECT_REVERB,
+    EFFECT_COUNT,
+} effect_id_t;
+
+typedef enum effects_filter_type {
+    EFFECTS_FILTER_ONE_POLE_LOWPASS = 0,  // 6 dB/octave, about half the cost of a biquad.
+    EFFECTS_FILTER_LOWPASS,               // 12 dB/octave biquad with resonance.
+    EFFECTS_FILTER_HIGHPASS,
+} effects_filter_type_t;
+
+typedef struct effects_stats {
+    uint32_t blocks;
+    uint64_t frames;
+    uint64_t busy_us;  // Time spent processing those frames.
+} effects_stats_t;
+
+// Allocates the delay and reverb lines. Returns false if they do not fit in the heap,
+// in which case every effect stays bypassed.
+bool effects_init(void);
+
+// Recomputes everything that depends on the output rate. Call before output starts
+// and whenever the rate changes.
+void effects_set_sample_rate(uint32_t sample_rate_hz);
+
+// `q_x1000` is the biquad's resonance in thousandths (707 is Butterworth); the
+// one-pole ignores it.
+void effects_set_filter(effects_filter_type_t type, uint32_t cutoff_hz, uint32_t q_x1000);
+
+// With `cross_feedback` each side's echo feeds the other's line, so repeats bounce
+// between the speakers.
+void effects_set_delay(uint32_t time_ms, uint16_t feedback_q15, uint16_t level_q15, bool cross_feedback);
+
+// Freeverb-style reverb: four damped combs into two allpasses per side. `room_q15`
+// sets the decay time, `damping_q15` how quickly the tail loses its highs.
+void effects_set_reverb(uint16_t room_q15, uint16_t damping_q15, uint16_t level_q15);
+
+// An effect brought back from bypass starts from silence rather than its stale state.
+void effects_set_bypass(effect_id_t effect, bool bypass);
+bool effects_bypassed(effect_id_t effect);
+
+// Runs every effect not bypassed over `frame_count` interleaved bus frames.
+void effects_process(int32_t *bus, uint32_t frame_count);
+
+const char *effects_name(effect_id_t effect);
+effects_stats_t effects_get_stats(effect_id_t effect);
+void effects_reset_stats(void);
+
+#endif  // EFFECTS_H
@@ -0,0 +1,75 @@
+#include "envelope.h"
+
+// Step that covers `range` in `ms` worth of blocks (at least one block).
+static int32_t step_for_duration(int32_t range, uint32_t ms, uint32_t output_rate_hz, uint32_t block_frames) {
+    const uint64_t blocks = static_cast<uint64_t>(ms) * output_rate_hz / (1000u * block_frames);
+    if (blocks <= 1u) {
+        return range > 0 ? range : 1;
+    }
+    const int32_t step = static_cast<int32_t>(range / static_cast<int64_t>(blocks));
+    return step > 0 ? step : 1;
+}
+
+void envelope_config_init(envelope_config_t *config, uint32_t attack_ms, uint32_t decay_ms, uint16_t sustain_q15,
+                          uint32_t release_ms, uint32_t output_rate_hz, uint32_t block_frames) {
+    const uint32_t sustain = sustain_q15 > 0x8000u ? 0x8000u : sustain_q15;
+    config->sustain_level = static_cast<int32_t>(sustain << 15u);
+    config->attack_step = step_for_duration(ENVELOPE_LEVEL_MAX, attack_ms, output_rate_hz, block_frames);
+    config->decay_step = step_for_duration(ENVELOPE_LEVEL_MAX - config->sustain_level, decay_ms, output_rate_hz, block_frames);
+    config->release_step = step_for_duration(ENVELOPE_LEVEL_MAX, release_ms, output_rate_hz, block_frames);
+}
+
+void envelope_start(envelope_t *envelope, const envelope_config_t *config, uint8_t velocity) {
+    if (velocity == 0u) {
+        velocity = 1u;
+    } else if (velocity > 127u) {
+        velocity = 127u;
+    }
+
+    const int64_t step = static_cast<int64_t>(config->attack_step) * 127 / (128 - velocity);
+    envelope->attack_step = step > ENVELOPE_LEVEL_MAX ? ENVELOPE_LEVEL_MAX : static_cast<int32_t>(step);
+    envelope->level = 0;
+    envelope->stage = ENVELOPE_ATTACK;
+}
+
+void envelope_release(envelope_t *envelope) {
+    if (envelope->stage != ENVELOPE_IDLE) {
+        envelope->stage = ENVELOPE_RELEASE;
+    }
+}
+
+int32_t envelope_advance(envelope_t *envelope, const envelope_config_t *config) {
+    switch (envelope->stage) {
+        case ENVELOPE_ATTACK:
+            if (envelope->level >= ENVELOPE_LEVEL_MAX - envelope->attack_step) {
+                envelope->level = ENVELOPE_LEVEL_MAX;
+                envelope->stage = ENVELOPE_DECAY;
+            } else {
+                envelope->level += envelope->attack_step;
+            }
+            break;
+        case ENVELOPE_DECAY:
+            if (envelope->level <= config->sustain_level + config->decay_step) {
+                envelope->level = config->sustain_level;
+                envelope->stage = config->sustain_level > 0 ? ENVELOPE_SUSTAIN : ENVELOPE_IDLE;
+            } else {
+                envelope->level -= config->decay_step;
+            }
+            break;
+        case ENVELOPE_SUSTAIN:
+            envelope->level = config->sustain_level;
+            break;
+        case ENVELOPE_RELEASE:
+            if (envelope->level <= config->release_step) {
+                envelope->level = 0;
+                envelope->stage = ENVELOPE_IDLE;
+            } else {
+                envelope->level -= config->release_step;
+            }
+            break;
+        case ENVELOPE_IDLE:
+            envelope->level = 0;
+            break;
+    }
+    return envelope->level;
+}
@@ -0,0 +1,50 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ADSR amplitude envelope evaluated once per render block. Levels are Q30 so that
+// slow stages still move by a non-zero step each block; the mixer ramps linearly
+// between successive block levels rather than evaluating the envelope per sample.
+#define ENVELOPE_LEVEL_MAX (1 << 30)
+
+typedef enum envelope_stage {
+    ENVELOPE_IDLE = 0,
+    ENVELOPE_ATTACK,
+    ENVELOPE_DECAY,
+    ENVELOPE_SUSTAIN,
+    ENVELOPE_RELEASE,
+} envelope_stage_t;
+
+// Per-block increments derived from stage times by envelope_config_init().
+typedef struct envelope_config {
+    int32_t attack_step;
+    int32_t decay_step;
+    int32_t sustain_level;
+    int32_t release_step;
+} envelope_config_t;
+
+typedef struct envelope {
+    envelope_stage_t stage;
+    int32_t level;
+    int32_t attack_step;  // Velocity-scaled copy of the configured attack step.
+} envelope_t;
+
+void envelope_config_init(envelope_config_t *config, uint32_t attack_ms, uint32_t decay_ms, uint16_t sustain_q15,
+                          uint32_t release_ms, uint32_t output_rate_hz, uint32_t block_frames);
+
+// Starts the attack. Harder notes attack faster: velocity 127 takes 1/127 of the
+// configured attack time, velocity 1 the full time.
+void envelope_start(envelope_t *envelope, const envelope_config_t *config, uint8_t velocity);
+
+void envelope_release(envelope_t *envelope);
+
+// Advances by one block and returns the level at the end of it.
+int32_t envelope_advance(envelope_t *envelope, const envelope_config_t *config);
+
+static inline bool envelope_is_silent(const envelope_t *envelope) {
+    return envelope->stage == ENVELOPE_IDLE;
+}
+
+#endif  // ENVELOPE_H
@@ -0,0 +1,632 @@
+// Renders a note-event file through the audio engine to a WAV file, the way core 1
+// would render it on the board, and reports how fast the render ran.
+//
+//   host_render [--rate HZ] [--bits 16|24] [--policy oldest|quietest|same-note]
+//               [--tail MS] [--fx LIST] <keymap.txt | sample.wav | sample.mps> <events.txt> <out.wav>
+//
+// --bits 24 renders through the 32-bit I2S output path and writes a 24-bit WAV.
+// --fx takes a comma-separated list of effects to run, e.g. "filter,reverb", with
+// the firmware's settings for each.
+//
+// Keymap paths are taken relative to the keymap's directory, with any "0:" drive
+// prefix dropped, so a card image copied to disk renders as is. A single sample is
+// mapped across the keyboard at middle C, like the firmware's fallback. A synth path
+// such as "synth:saw", in a keymap or in place of the sample, plays the built-in
+// wavetable voices.
+//
+// The event file holds one event per line, times in milliseconds from the start:
+//
+//   # time_ms  on/off  note  velocity
+//   0          on      60    100
+//   500        off     60
+//
+// After the last event, rendering continues until every voice has finished or
+// --tail milliseconds have passed; with a delay or reverb running, for the whole tail.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "adpcm.h"
+#include "effects.h"
+#include "envelope.h"
+#include "i2s_frame.h"
+#include "keymap.h"
+#include "sample_cache.h"
+#include "sample_file.h"
+#include "voice_mixer.h"
+#include "wavetable.h"
+
+// Every zone is loaded before rendering starts, so the budget only has to hold them.
+#define HOST_SAMPLE_CACHE_BUDGET_BYTES (256u * 1024u * 1024u)
+#define HOST_DEFAULT_RATE_HZ 44100u
+#define HOST_DEFAULT_TAIL_MS 2000u
+#define HOST_LOAD_CHUNK_FRAMES 4096u
+
+// The firmware's MIX_OUTPUT_GAIN.
+#define HOST_OUTPUT_GAIN (VOICE_GAIN_UNITY / 2u)
+
+typedef struct host_event {
+    uint64_t frame;
+    bool on;
+    uint8_t note;
+    uint8_t velocity;
+} host_event_t;
+
+typedef struct render_stats {
+    uint64_t frames;
+    uint64_t voice_frames;  // Sum over blocks of voices sounding times block length.
+    uint32_t peak_voices;
+    double seconds;         // Wall time spent applying events and rendering.
+} render_stats_t;
+
+static std::string g_sample_dir;
+
+// sample_reader_t over stdio.
+static bool stdio_read(void *context, void *data, uint32_t byte_count) {
+    return std::fread(data, 1u, byte_count, static_cast<FILE *>(context)) == byte_count;
+}
+
+static bool stdio_seek(void *context, uint32_t offset) {
+    return std::fseek(static_cast<FILE *>(context), static_cast<long>(offset), SEEK_SET) == 0;
+}
+
+static uint32_t stdio_tell(void *context) {
+    return static_cast<uint32_t>(std::ftell(static_cast<FILE *>(context)));
+}
+
+static bool stdio_reader(FILE *file, sample_reader_t *reader) {
+    if (std::fseek(file, 0, SEEK_END) != 0) {
+        return false;
+    }
+    const long size = std::ftell(file);
+    if (size < 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    *reader = {file, stdio_read, stdio_seek, stdio_tell, static_cast<uint32_t>(size)};
+    return true;
+}
+
+// Maps a keymap path such as "0:/piano/c4.mps" onto the directory the keymap was read from.
+static std::string host_path(const char *path) {
+    const char *colon = std::strchr(path, ':');
+    if (colon) {
+        path = colon + 1;
+    }
+    while (*path == '/') {
+        ++path;
+    }
+    return g_sample_dir + path;
+}
+
+// Sample cache loader, as in the firmware but over stdio.
+static FILE *g_load_file = nullptr;
+static bool g_load_is_native = false;
+static sample_encoding_t g_load_encoding = SAMPLE_ENCODING_FRAMES;
+static wav_sample_t g_load_wav;
+static long g_load_data_offset = 0;
+static std::vector<uint8_t> g_load_scratch;
+
+static bool open_cached_sample(const char *path, sample_frames_t *sample) {
+    const std::string file_path = host_path(path);
+    g_load_file = std::fopen(file_path.c_str(), "rb");
+    sample_reader_t reader;
+    if (!g_load_file || !stdio_reader(g_load_file, &reader)) {
+        printf("Failed to open sample file: %s\n", file_path.c_str());
+        if (g_load_file) {
+            std::fclose(g_load_file);
+            g_load_file = nullptr;
+        }
+        return false;
+    }
+
+    native_sample_header_t native;
+    if (!parse_sample(&reader, file_path.c_str(), &g_load_is_native, &native, &g_load_wav)) {
+        std::fclose(g_load_file);
+        g_load_file = nullptr;
+        return false;
+    }
+
+    g_load_data_offset = std::ftell(g_load_file);
+    g_load_encoding = g_load_is_native ? native_sample_encoding(&native) : SAMPLE_ENCODING_FRAMES;
+    sample->encoding = g_load_encoding;
+    if (g_load_is_native) {
+        sample->frame_count = native.frame_count;
+        sample->sample_rate_hz = native.sample_rate_hz;
+        sample->loop_start = native.loop_start;
+        sample->loop_end = native.loop_end;
+    } else {
+        sample->frame_count = static_cast<uint32_t>(g_load_wav.data_size_bytes / g_load_wav.block_align);
+        sample->sample_rate_hz = g_load_wav.sample_rate_hz;
+        sample->loop_start = g_load_wav.loop_start;
+        sample->loop_end = g_load_wav.loop_end;
+    }
+    return true;
+}
+
+static bool read_cached_sample(void *data, uint32_t frame_count) {
+    if (g_load_is_native) {
+        const size_t byte_count = sample_storage_bytes(g_load_encoding, frame_count);
+        return std::fread(data, 1u, byte_count, g_load_file) == byte_count;
+    }
+
+    const size_t byte_count = static_cast<size_t>(frame_count) * g_load_wav.block_align;
+    g_load_scratch.resize(byte_count);
+    if (std::fread(g_load_scratch.data(), 1u, byte_count, g_load_file) != byte_count) {
+        return false;
+    }
+    convert_pcm_to_i2s_frames(g_load_wav, g_load_scratch.data(), frame_count, static_cast<uint32_t *>(data));
+    return true;
+}
+
+static bool seek_cached_sample(uint32_t frame) {
+    const size_t offset = g_load_is_native ? sample_storage_bytes(g_load_encoding, frame)
+                                           : static_cast<size_t>(frame) * g_load_wav.block_align;
+    return std::fseek(g_load_file, g_load_data_offset + static_cast<long>(offset), SEEK_SET) == 0;
+}
+
+static void close_cached_sample() {
+    std::fclose(g_load_file);
+    g_load_file = nullptr;
+}
+
+static const sample_cache_loader_t k_sample_loader = {
+    open_cached_sample,
+    read_cached_sample,
+    seek_cached_sample,
+    close_cached_sample,
+};
+
+static void release_cached_sample(const void *owner) {
+    sample_cache_release(static_cast<const sample_cache_entry_t *>(owner));
+}
+
+static bool ends_with(const std::string &text, const char *suffix) {
+    const size_t length = std::strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static bool load_keymap(const std::string &path) {
+    FILE *file = std::fopen(path.c_str(), "r");
+    if (!file) {
+        printf("Failed to open keymap: %s\n", path.c_str());
+        return false;
+    }
+
+    keymap_clear();
+    char line[256];
+    uint32_t line_number = 0u;
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), file)) {
+        ++line_number;
+        keymap_zone_t zone;
+        const keymap_line_t kind = keymap_parse_line(line, &zone);
+        if (kind == KEYMAP_LINE_INVALID) {
+            printf("Keymap %s line %lu is invalid\n", path.c_str(), static_cast<unsigned long>(line_number));
+            ok = false;
+        } else if (kind == KEYMAP_LINE_ZONE && !keymap_add_zone(&zone)) {
+            printf("Keymap %s has more than %u zones\n", path.c_str(), KEYMAP_MAX_ZONES);
+            ok = false;
+        }
+    }
+    std::fclose(file);
+
+    if (ok && !keymap_build()) {
+        printf("Keymap %s has no zones or too many velocity layers\n", path.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+// One zone covering every note and velocity, recorded at middle C.
+static bool load_single_sample_keymap(const std::string &name) {
+    keymap_zone_t zone = {};
+    if (name.size() >= sizeof(zone.path)) {
+        printf("Sample file name too long: %s\n", name.c_str());
+        return false;
+    }
+    std::strcpy(zone.path, name.c_str());
+    zone.low_note = 0u;
+    zone.high_note = 127u;
+    zone.low_velocity = 1u;
+    zone.high_velocity = 127u;
+    zone.root_note = 60u;
+    zone.tune_cents = 0;
+    zone.tune_q16 = 1u << 16u;
+
+    keymap_clear();
+    keymap_add_zone(&zone);
+    return keymap_build();
+}
+
+static bool preload_zones() {
+    for (uint32_t i = 0; i < keymap_zone_count(); ++i) {
+        const char *path = keymap_zone(i)->path;
+        wavetable_waveform_t waveform;
+        if (wavetable_parse_path(path, &waveform)) {
+            continue;
+        }
+
+        if (!sample_cache_begin_load(path, false)) {
+            printf("Failed to load %s\n", path);
+            return false;
+        }
+
+        sample_cache_load_result_t result;
+        do {
+            result = sample_cache_load_step(HOST_LOAD_CHUNK_FRAMES);
+        } while (result == SAMPLE_CACHE_LOAD_MORE);
+        if (result == SAMPLE_CACHE_LOAD_FAILED) {
+            printf("Failed to read %s\n", path);
+            return false;
+        }
+    }
+
+    const sample_cache_stats_t stats = sample_cache_get_stats();
+    printf("Samples: %lu loaded, %lu KB\n", static_cast<unsigned long>(stats.entry_count),
+           static_cast<unsigned long>(stats.bytes_used / 1024u));
+    return true;
+}
+
+static bool load_events(const char *path, uint32_t output_rate_hz, std::vector<host_event_t> *events) {
+    FILE *file = std::fopen(path, "r");
+    if (!file) {
+        printf("Failed to open event file: %s\n", path);
+        return false;
+    }
+
+    char line[128];
+    uint32_t line_number = 0u;
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), file)) {
+        ++line_number;
+        const char *text = line + std::strspn(line, " \t\r\n");
+        if (*text == '\0' || *text == '#') {
+            continue;
+        }
+
+        double time_ms = 0.0;
+        char kind[8];
+        unsigned note = 0u;
+        unsigned velocity = 0u;
+        const int fields = std::sscanf(text, "%lf %7s %u %u", &time_ms, kind, &note, &velocity);
+        host_event_t event = {};
+        event.on = fields >= 3 && std::strcmp(kind, "on") == 0;
+        const bool off = fields >= 3 && std::strcmp(kind, "off") == 0;
+        if ((!event.on && !off) || time_ms < 0.0 || note > 127u || (event.on && (fields < 4 || velocity < 1u ||
+                                                                                  velocity > 127u))) {
+            printf("Event file %s line %lu is invalid\n", path, static_cast<unsigned long>(line_number));
+            ok = false;
+            break;
+        }
+
+        event.frame = static_cast<uint64_t>(time_ms * output_rate_hz / 1000.0 + 0.5);
+        event.note = static_cast<uint8_t>(note);
+        event.velocity = static_cast<uint8_t>(velocity);
+        events->push_back(event);
+    }
+    std::fclose(file);
+
+    // Events at the same time keep their file order.
+    std::stable_sort(events->begin(), events->end(),
+                     [](const host_event_t &a, const host_event_t &b) { return a.frame < b.frame; });
+    return ok;
+}
+
+// As start_note() in the firmware, with every sample already cached.
+static void start_note(const host_event_t &event, uint32_t block_offset, uint32_t output_rate_hz) {
+    const keymap_zone_t *zone = keymap_lookup(event.note, event.velocity);
+    if (!zone) {
+        return;
+    }
+
+    wavetable_waveform_t waveform;
+    if (wavetable_parse_path(zone->path, &waveform)) {
+        const uint32_t step = voice_pitch_step(static_cast<int32_t>(event.note) -
+                                                   static_cast<int32_t>(WAVETABLE_ROOT_NOTE),
+                                               WAVETABLE_SAMPLE_RATE_HZ, output_rate_hz);
+        voice_params_t params = {};
+        params.pitch_step = static_cast<uint32_t>(static_cast<uint64_t>(step) * zone->tune_q16 >> 16u);
+        params.data = wavetable_table(waveform, params.pitch_step);
+        params.encoding = SAMPLE_ENCODING_FRAMES;
+        params.frame_count = WAVETABLE_FRAMES;
+        params.loop_start = 0u;
+        params.loop_end = WAVETABLE_FRAMES;
+        params.gain = VOICE_GAIN_UNITY;
+        params.velocity = event.velocity;
+        params.block_offset = block_offset;
+        voice_mixer_note_on(event.note, &params);
+        return;
+    }
+
+    const sample_cache_entry_t *entry = sample_cache_acquire(zone->path);
+    if (!entry) {
+        return;
+    }
+
+    const uint32_t step = voice_pitch_step(static_cast<int32_t>(event.note) - zone->root_note, entry->sample_rate_hz,
+                                           output_rate_hz);
+    voice_params_t params = {};
+    params.data = entry->data;
+    params.encoding = entry->encoding;
+    params.frame_count = entry->frame_count;
+    params.loop_start = entry->loop_start;
+    params.loop_end = entry->loop_end;
+    params.gain = VOICE_GAIN_UNITY;
+    params.velocity = event.velocity;
+    params.pitch_step = static_cast<uint32_t>(static_cast<uint64_t>(step) * zone->tune_q16 >> 16u);
+    params.block_offset = block_offset;
+    params.owner = entry;
+    if (voice_mixer_note_on(event.note, &params) < 0) {
+        sample_cache_release(entry);
+    }
+}
+
+// Renders into `output` as packed frames, or with `wide` as voice_mixer_render_32() words.
+static void render(const std::vector<host_event_t> &events, uint32_t output_rate_hz, uint64_t tail_frames, bool wide,
+                   std::vector<uint32_t> *output, render_stats_t *stats) {
+    const uint64_t last_event_frame = events.empty() ? 0u : events.back().frame;
+    size_t next_event = 0u;
+    uint32_t block[MIXER_BLOCK_FRAMES * 2u];
+    // Delay and reverb keep sounding after the voices stop.
+    const bool echoes = !effects_bypassed(EFFECT_DELAY) || !effects_bypassed(EFFECT_REVERB);
+    std::memset(stats, 0, sizeof(*stats));
+
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        const uint64_t block_start = stats->frames;
+        for (; next_event < events.size() && events[next_event].frame < block_start + MIXER_BLOCK_FRAMES;
+             ++next_event) {
+            const host_event_t &event = events[next_event];
+            const uint32_t offset = static_cast<uint32_t>(event.frame - block_start);
+            if (event.on) {
+                start_note(event, offset, output_rate_hz);
+            } else {
+                voice_mixer_note_off_at(event.note, offset);
+            }
+        }
+
+        const uint32_t voices = voice_mixer_active_count();
+        if (next_event == events.size() && block_start > last_event_frame &&
+            ((voices == 0u && !echoes) || block_start >= last_event_frame + tail_frames)) {
+            break;
+        }
+
+        if (wide) {
+            voice_mixer_render_32(block, MIXER_BLOCK_FRAMES);
+            output->insert(output->end(), block, block + MIXER_BLOCK_FRAMES * 2u);
+        } else {
+            voice_mixer_render(block, MIXER_BLOCK_FRAMES);
+            output->insert(output->end(), block, block + MIXER_BLOCK_FRAMES);
+        }
+        stats->frames += MIXER_BLOCK_FRAMES;
+        stats->voice_frames += static_cast<uint64_t>(voices) * MIXER_BLOCK_FRAMES;
+        stats->peak_voices = std::max(stats->peak_voices, voices);
+    }
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void put_u16_le(uint8_t *bytes, uint16_t value) {
+    bytes[0] = static_cast<uint8_t>(value);
+    bytes[1] = static_cast<uint8_t>(value >> 8u);
+}
+
+static void put_u32_le(uint8_t *bytes, uint32_t value) {
+    put_u16_le(bytes, static_cast<uint16_t>(value));
+    put_u16_le(bytes + 2, static_cast<uint16_t>(value >> 16u));
+}
+
+// Writes render() output as a stereo WAV: 16-bit from packed frames, 24-bit from
+// 32-bit output words.
+static bool write_wav(const char *path, const std::vector<uint32_t> &output, bool wide, uint32_t sample_rate_hz) {
+    FILE *file = std::fopen(path, "wb");
+    if (!file) {
+        printf("Failed to create %s\n", path);
+        return false;
+    }
+
+    const uint32_t sample_bytes = wide ? 3u : 2u;
+    const uint32_t block_align = sample_bytes * 2u;
+    const uint32_t data_bytes = static_cast<uint32_t>(output.size() * (wide ? sample_bytes : block_align));
+    uint8_t header[44];
+    std::memcpy(header, "RIFF", 4);
+    put_u32_le(header + 4, 36u + data_bytes);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32_le(header + 16, 16u);
+    put_u16_le(header + 20, 1u);
+    put_u16_le(header + 22, 2u);
+    put_u32_le(header + 24, sample_rate_hz);
+    put_u32_le(header + 28, sample_rate_hz * block_align);
+    put_u16_le(header + 32, static_cast<uint16_t>(block_align));
+    put_u16_le(header + 34, static_cast<uint16_t>(sample_bytes * 8u));
+    std::memcpy(header + 36, "data", 4);
+    put_u32_le(header + 40, data_bytes);
+
+    std::vector<uint8_t> pcm(data_bytes);
+    for (size_t i = 0; i < output.size(); ++i) {
+        if (wide) {
+            // The sample is left-justified; its top three bytes, little-endian.
+            pcm[i * 3u] = static_cast<uint8_t>(output[i] >> 8u);
+            pcm[i * 3u + 1u] = static_cast<uint8_t>(output[i] >> 16u);
+            pcm[i * 3u + 2u] = static_cast<uint8_t>(output[i] >> 24u);
+        } else {
+            put_u16_le(&pcm[i * 4u], static_cast<uint16_t>(i2s_frame_left(output[i])));
+            put_u16_le(&pcm[i * 4u + 2u], static_cast<uint16_t>(i2s_frame_right(output[i])));
+        }
+    }
+
+    const bool written = std::fwrite(header, 1u, sizeof(header), file) == sizeof(header) &&
+                         std::fwrite(pcm.data(), 1u, pcm.size(), file) == pcm.size();
+    if (std::fclose(file) != 0 || !written) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void print_stats(const render_stats_t &stats, uint32_t output_rate_hz) {
+    const double audio_seconds = static_cast<double>(stats.frames) / output_rate_hz;
+    const double seconds = stats.seconds > 0.0 ? stats.seconds : 1e-9;
+    printf("Rendered %llu frames (%.2f s of audio) in %.1f ms: %.0f frames/s, %.1fx real time\n",
+           static_cast<unsigned long long>(stats.frames), audio_seconds, stats.seconds * 1000.0,
+           stats.frames / seconds, audio_seconds / seconds);
+
+    // Voice-frames per second of render time over the output rate is how many voices
+    // this machine could keep sounding in real time at the mix measured here.
+    const double average_voices = stats.frames ? static_cast<double>(stats.voice_frames) / stats.frames : 0.0;
+    printf("Voices: peak %lu, average %.2f", static_cast<unsigned long>(stats.peak_voices), average_voices);
+    if (stats.voice_frames > 0u) {
+        printf(", %.0f voice-frames/s, ~%.0f voices at real time", stats.voice_frames / seconds,
+               stats.voice_frames / seconds / output_rate_hz);
+    }
+    printf("\n");
+
+    const voice_steal_stats_t steals = voice_mixer_get_steal_stats();
+    printf("Steals: %lu, %lu without a fade\n", static_cast<unsigned long>(steals.steals),
+           static_cast<unsigned long>(steals.unfaded_steals));
+}
+
+// Time each effect took against the audio it processed.
+static void print_effect_stats(uint32_t output_rate_hz) {
+    for (uint32_t i = 0; i < EFFECT_COUNT; ++i) {
+        const effect_id_t effect = static_cast<effect_id_t>(i);
+        const effects_stats_t stats = effects_get_stats(effect);
+        if (effects_bypassed(effect) || stats.frames == 0u) {
+            continue;
+        }
+
+        const double ns_per_frame = stats.busy_us * 1000.0 / stats.frames;
+        printf("Effect %-6s %.2f ns per frame, %.3f%% of real time\n", effects_name(effect), ns_per_frame,
+               ns_per_frame * output_rate_hz / 1e7);
+    }
+}
+
+// Parses a comma-separated list of effect names into `enabled`.
+static bool parse_effects(const char *list, bool *enabled) {
+    std::string names = list;
+    size_t start = 0u;
+    while (start <= names.size()) {
+        const size_t end = std::min(names.find(',', start), names.size());
+        const std::string name = names.substr(start, end - start);
+        bool found = false;
+        for (uint32_t i = 0; i < EFFECT_COUNT; ++i) {
+            if (name == effects_name(static_cast<effect_id_t>(i))) {
+                enabled[i] = true;
+                found = true;
+            }
+        }
+        if (!found) {
+            printf("Unknown effect: %s\n", name.c_str());
+            return false;
+        }
+        start = end + 1u;
+    }
+    return true;
+}
+
+static void print_usage() {
+    printf("usage: host_render [--rate HZ] [--bits 16|24] [--policy oldest|quietest|same-note]\n"
+           "                   [--tail MS] [--fx filter,delay,reverb]\n"
+           "                   <keymap.txt | sample.wav | sample.mps> <events.txt> <out.wav>\n");
+}
+
+int main(int argc, char **argv) {
+    uint32_t output_rate_hz = HOST_DEFAULT_RATE_HZ;
+    uint32_t tail_ms = HOST_DEFAULT_TAIL_MS;
+    voice_steal_policy_t policy = VOICE_STEAL_QUIETEST;
+    bool wide = false;
+    bool effects_enabled[EFFECT_COUNT] = {};
+
+    int arg = 1;
+    for (; arg + 1 < argc && std::strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        const char *value = argv[arg + 1];
+        if (std::strcmp(argv[arg], "--rate") == 0) {
+            output_rate_hz = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(argv[arg], "--bits") == 0 && (std::strcmp(value, "16") == 0 ||
+                                                             std::strcmp(value, "24") == 0)) {
+            wide = std::strcmp(value, "24") == 0;
+        } else if (std::strcmp(argv[arg], "--fx") == 0) {
+            if (!parse_effects(value, effects_enabled)) {
+                print_usage();
+                return 2;
+            }
+        } else if (std::strcmp(argv[arg], "--tail") == 0) {
+            tail_ms = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(argv[arg], "--policy") == 0 && std::strcmp(value, "oldest") == 0) {
+            policy = VOICE_STEAL_OLDEST;
+        } else if (std::strcmp(argv[arg], "--policy") == 0 && std::strcmp(value, "quietest") == 0) {
+            policy = VOICE_STEAL_QUIETEST;
+        } else if (std::strcmp(argv[arg], "--policy") == 0 && std::strcmp(value, "same-note") == 0) {
+            policy = VOICE_STEAL_SAME_NOTE;
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    if (argc - arg != 3 || output_rate_hz == 0u) {
+        print_usage();
+        return 2;
+    }
+
+    const std::string instrument = argv[arg];
+    const size_t slash = instrument.find_last_of('/');
+    g_sample_dir = slash == std::string::npos ? std::string() : instrument.substr(0, slash + 1u);
+    const std::string instrument_name = slash == std::string::npos ? instrument : instrument.substr(slash + 1u);
+
+    const bool loaded = ends_with(instrument, ".txt") ? load_keymap(instrument)
+                                                       : load_single_sample_keymap(instrument_name);
+    if (!loaded) {
+        return 1;
+    }
+
+    if (!wavetable_init()) {
+        printf("Out of memory for wavetables\n");
+        return 1;
+    }
+
+    sample_cache_init(HOST_SAMPLE_CACHE_BUDGET_BYTES, &k_sample_loader);
+    if (!preload_zones()) {
+        return 1;
+    }
+
+    std::vector<host_event_t> events;
+    if (!load_events(argv[arg + 1], output_rate_hz, &events)) {
+        return 1;
+    }
+
+    voice_mixer_init();
+    voice_mixer_set_release_callback(release_cached_sample);
+    voice_mixer_set_steal_policy(policy);
+    voice_mixer_set_output(HOST_OUTPUT_GAIN, true);
+
+    // The firmware's effects (see init_effects()).
+    if (!effects_init()) {
+        printf("Out of memory for effects\n");
+        return 1;
+    }
+    effects_set_filter(EFFECTS_FILTER_LOWPASS, 8000u, 707u);
+    effects_set_delay(180u, VOICE_GAIN_UNITY / 3u, VOICE_GAIN_UNITY / 4u, true);
+    effects_set_reverb(VOICE_GAIN_UNITY / 2u, VOICE_GAIN_UNITY / 2u, VOICE_GAIN_UNITY / 3u);
+    effects_set_sample_rate(output_rate_hz);
+    for (uint32_t i = 0; i < EFFECT_COUNT; ++i) {
+        effects_set_bypass(static_cast<effect_id_t>(i), !effects_enabled[i]);
+    }
+    voice_mixer_set_bus_callback(effects_process);
+
+    // The firmware's envelope (see set_output_rate()).
+    envelope_config_t envelope;
+    envelope_config_init(&envelope, 10u, 800u, VOICE_GAIN_UNITY / 3u, 250u, output_rate_hz, MIXER_BLOCK_FRAMES);
+    voice_mixer_set_envelope(&envelope);
+
+    std::vector<uint32_t> output;
+    render_stats_t stats;
+    render(events, output_rate_hz, static_cast<uint64_t>(tail_ms) * output_rate_hz / 1000u, wide, &output, &stats);
+
+    print_stats(stats, output_rate_hz);
+    print_effect_stats(output_rate_hz);
+    return write_wav(argv[arg + 2], output, wide, output_rate_hz) ? 0 : 1;
+}
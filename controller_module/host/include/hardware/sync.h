@@ -0,0 +1,31 @@
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+// Host stand-in for the Pico SDK spin locks used by the audio engine. The render
+// harness runs everything on one thread, so the locks only have to exist.
+typedef volatile uint32_t spin_lock_t;
+
+static inline unsigned spin_lock_claim_unused(bool required) {
+    (void)required;
+    return 0u;
+}
+
+static inline spin_lock_t *spin_lock_init(unsigned lock_num) {
+    static spin_lock_t locks[1];
+    (void)lock_num;
+    return &locks[0];
+}
+
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    (void)lock;
+    return 0u;
+}
+
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    (void)lock;
+    (void)saved_irq;
+}
+
+#endif  // HOST_HARDWARE_SYNC_H
@@ -0,0 +1,15 @@
+#ifndef HOST_PICO_TIME_H
+#define HOST_PICO_TIME_H
+
+#include <stdint.h>
+
+#include <chrono>
+
+// Host stand-in for the Pico SDK's microsecond timer, used for the effects' cost
+// accounting.
+static inline uint32_t time_us_32(void) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+#endif  // HOST_PICO_TIME_H
@@ -0,0 +1,80 @@
+#include "i2s_clock.h"
+
+bool i2s_clock_divider(uint32_t sys_clock_hz, uint32_t sample_rate_hz, uint32_t pio_cycles_per_frame,
+                       i2s_clock_divider_t *divider) {
+    if (sample_rate_hz == 0u || pio_cycles_per_frame == 0u) {
+        return false;
+    }
+
+    // Divider in 1/256ths: sys_clock_hz * 256 / (sample_rate_hz * pio_cycles_per_frame), rounded.
+    const uint64_t target = static_cast<uint64_t>(sys_clock_hz) * 256u;
+    const uint64_t pio_hz = static_cast<uint64_t>(sample_rate_hz) * pio_cycles_per_frame;
+    const uint64_t scaled = (target + pio_hz / 2u) / pio_hz;
+    if (scaled < 256u || scaled > 0xffffffu) {
+        return false;
+    }
+
+    divider->integer = static_cast<uint16_t>(scaled >> 8u);
+    divider->fraction = static_cast<uint8_t>(scaled & 0xffu);
+    divider->achieved_mhz = static_cast<uint32_t>(target * 1000u / (scaled * pio_cycles_per_frame));
+
+    // achieved / requested - 1 = (target - scaled * pio_hz) / (scaled * pio_hz); the
+    // numerator is at most half a divider step, so this cannot overflow.
+    const int64_t remainder = static_cast<int64_t>(target) - static_cast<int64_t>(scaled * pio_hz);
+    divider->error_ppb = static_cast<int32_t>(remainder * 1000000000 / static_cast<int64_t>(scaled * pio_hz));
+    return true;
+}
+
+static bool better_clock(const i2s_sys_clock_t *a, const i2s_sys_clock_t *b) {
+    const int32_t a_error = a->divider.error_ppb < 0 ? -a->divider.error_ppb : a->divider.error_ppb;
+    const int32_t b_error = b->divider.error_ppb < 0 ? -b->divider.error_ppb : b->divider.error_ppb;
+    if (a_error != b_error) {
+        return a_error < b_error;
+    }
+    if ((a->divider.fraction == 0u) != (b->divider.fraction == 0u)) {
+        return a->divider.fraction == 0u;
+    }
+    if (a->sys_clock_hz != b->sys_clock_hz) {
+        return a->sys_clock_hz > b->sys_clock_hz;
+    }
+    // The same clock from a faster VCO has less PLL jitter.
+    return a->vco_hz > b->vco_hz;
+}
+
+bool i2s_clock_find_sys_clock(uint32_t sample_rate_hz, uint32_t pio_cycles_per_frame, uint32_t reference_hz,
+                              uint32_t min_hz, uint32_t max_hz, i2s_sys_clock_t *clock) {
+    bool found = false;
+    for (uint32_t fbdiv = I2S_PLL_FBDIV_MIN; fbdiv <= I2S_PLL_FBDIV_MAX; ++fbdiv) {
+        const uint64_t vco_hz = static_cast<uint64_t>(reference_hz) * fbdiv;
+        if (vco_hz < I2S_PLL_VCO_MIN_HZ || vco_hz > I2S_PLL_VCO_MAX_HZ) {
+            continue;
+        }
+
+        // Post dividers as the SDK uses them, post_div1 >= post_div2.
+        for (uint32_t post_div1 = 1u; post_div1 <= I2S_PLL_POSTDIV_MAX; ++post_div1) {
+            for (uint32_t post_div2 = 1u; post_div2 <= post_div1; ++post_div2) {
+                const uint32_t post_div = post_div1 * post_div2;
+                if (vco_hz % post_div != 0u) {
+                    continue;
+                }
+
+                i2s_sys_clock_t candidate;
+                candidate.sys_clock_hz = static_cast<uint32_t>(vco_hz / post_div);
+                if (candidate.sys_clock_hz < min_hz || candidate.sys_clock_hz > max_hz ||
+                    !i2s_clock_divider(candidate.sys_clock_hz, sample_rate_hz, pio_cycles_per_frame,
+                                       &candidate.divider)) {
+                    continue;
+                }
+                candidate.vco_hz = static_cast<uint32_t>(vco_hz);
+                candidate.post_div1 = static_cast<uint8_t>(post_div1);
+                candidate.post_div2 = static_cast<uint8_t>(post_div2);
+
+                if (!found || better_clock(&candidate, clock)) {
+                    *clock = candidate;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,50 @@
+#ifndef I2S_CLOCK_H
+#define I2S_CLOCK_H
+
+#include <stdint.h>
+
+// Sample-rate arithmetic for the audio_i2s PIO programs. Each stereo frame is two
+// slots and every bit takes two PIO cycles (out, then jmp or set), so the state
+// machine must run at exactly 64x the sample rate with 16-bit slots and 128x with
+// 32-bit ones.
+#define I2S_PIO_CYCLES_PER_FRAME_16 64u
+#define I2S_PIO_CYCLES_PER_FRAME_32 128u
+
+// PLL limits used when searching for a clk_sys (RP2350 datasheet, REFDIV 1).
+#define I2S_PLL_FBDIV_MIN 16u
+#define I2S_PLL_FBDIV_MAX 320u
+#define I2S_PLL_VCO_MIN_HZ 750000000u
+#define I2S_PLL_VCO_MAX_HZ 1600000000u
+#define I2S_PLL_POSTDIV_MAX 7u
+
+// A PIO clock divider in the hardware's 16.8 format and the rate it really gives.
+typedef struct i2s_clock_divider {
+    uint16_t integer;
+    uint8_t fraction;          // 1/256ths; 0 gives a jitter-free bit clock.
+    uint32_t achieved_mhz;     // Achieved sample rate in millihertz.
+    int32_t error_ppb;         // Achieved rate relative to the requested one, parts per billion.
+} i2s_clock_divider_t;
+
+// Nearest divider for `sample_rate_hz` with clk_sys at `sys_clock_hz`, for a program
+// taking `pio_cycles_per_frame` cycles per frame. Returns false if the rate is out of
+// the divider's range.
+bool i2s_clock_divider(uint32_t sys_clock_hz, uint32_t sample_rate_hz, uint32_t pio_cycles_per_frame,
+                       i2s_clock_divider_t *divider);
+
+// A clk_sys that the system PLL can produce, with the divider it gives.
+typedef struct i2s_sys_clock {
+    uint32_t sys_clock_hz;
+    uint32_t vco_hz;
+    uint8_t post_div1;
+    uint8_t post_div2;
+    i2s_clock_divider_t divider;
+} i2s_sys_clock_t;
+
+// Searches the PLL settings reachable from `reference_hz` for the clk_sys in
+// [min_hz, max_hz] whose divider lands closest to `sample_rate_hz`, preferring an
+// integer divider, then the faster clock, then the faster VCO, among equally
+// accurate ones. Returns false if no setting falls in the range.
+bool i2s_clock_find_sys_clock(uint32_t sample_rate_hz, uint32_t pio_cycles_per_frame, uint32_t reference_hz,
+                              uint32_t min_hz, uint32_t max_hz, i2s_sys_clock_t *clock);
+
+#endif  // I2S_CLOCK_H
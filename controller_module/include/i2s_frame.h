@@ -0,0 +1,38 @@
+#ifndef I2S_FRAME_H
+#define I2S_FRAME_H
+
+#include <stdint.h>
+
+// One stereo frame as consumed by the audio_i2s PIO program: left sample in the
+// upper half-word, right sample in the lower half-word.
+static inline uint32_t pack_i2s_frame(int16_t left, int16_t right) {
+    return ((uint32_t)(uint16_t)left << 16u) | (uint16_t)right;
+}
+
+static inline int16_t i2s_frame_left(uint32_t frame) {
+    return (int16_t)(frame >> 16u);
+}
+
+static inline int16_t i2s_frame_right(uint32_t frame) {
+    return (int16_t)(frame & 0xffffu);
+}
+
+// How a sample's frames are held in memory: packed I2S frames, or IMA-ADPCM blocks
+// (see adpcm.h) that the voice renderer decodes as it plays.
+typedef enum sample_encoding {
+    SAMPLE_ENCODING_FRAMES = 0,
+    SAMPLE_ENCODING_ADPCM_MONO,
+    SAMPLE_ENCODING_ADPCM_STEREO,
+} sample_encoding_t;
+
+// A whole sample converted to packed frames, with its recorded rate and sustain loop.
+typedef struct sample_frames {
+    uint32_t *frames;
+    sample_encoding_t encoding;
+    uint32_t frame_count;
+    uint32_t sample_rate_hz;
+    uint32_t loop_start;
+    uint32_t loop_end;  // exclusive; 0 when the sample does not loop
+} sample_frames_t;
+
+#endif  // I2S_FRAME_H
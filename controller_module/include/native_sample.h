@@ -0,0 +1,40 @@
+#ifndef NATIVE_SAMPLE_H
+#define NATIVE_SAMPLE_H
+
+#include <stdint.h>
+
+// On-card sample format holding frames already packed for the audio_i2s PIO
+// program, produced on the host by convert_sample.py. All fields little-endian:
+//
+//   0  char[4]  magic "MPSM"
+//   4  u16      version
+//   6  u16      data offset in bytes (a whole number of 512-byte sectors)
+//   8  u32      sample rate in Hz
+//  12  u32      frame count
+//  16  u32      loop start frame
+//  20  u32      loop end frame (exclusive); 0 when the sample does not loop
+//  24  u32      flags, NATIVE_SAMPLE_FLAG_*; other bits must be 0
+//
+// Frames follow at the data offset as u32 pack_i2s_frame() words. Keeping the data
+// sector-aligned lets FatFs read whole sectors straight into the DMA buffers. With
+// NATIVE_SAMPLE_FLAG_ADPCM the data is IMA-ADPCM blocks instead (see adpcm.h), one
+// channel per block if NATIVE_SAMPLE_FLAG_MONO is also set, otherwise two.
+#define NATIVE_SAMPLE_MAGIC "MPSM"
+#define NATIVE_SAMPLE_VERSION 1u
+#define NATIVE_SAMPLE_HEADER_BYTES 28u
+#define NATIVE_SAMPLE_DATA_ALIGN 512u
+
+#define NATIVE_SAMPLE_FLAG_ADPCM 0x1u
+#define NATIVE_SAMPLE_FLAG_MONO 0x2u  // ADPCM only; played on both sides.
+
+typedef struct native_sample_header {
+    uint16_t version;
+    uint16_t data_offset;
+    uint32_t sample_rate_hz;
+    uint32_t frame_count;
+    uint32_t loop_start;
+    uint32_t loop_end;
+    uint32_t flags;
+} native_sample_header_t;
+
+#endif  // NATIVE_SAMPLE_H
@@ -13,6 +13,10 @@ typedef struct wav_sample {
     uint16_t bits_per_sample;
     size_t data_size_bytes;
     const uint8_t *data;
+    // First sustain loop from the smpl chunk, in frames. loop_end is exclusive and
+    // 0 when the file has no loop.
+    uint32_t loop_start;
+    uint32_t loop_end;
 } wav_sample_t;
 
 #endif  // WAV_SAMPLE_H
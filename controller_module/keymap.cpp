@@ -0,0 +1,127 @@
+#include "keymap.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static keymap_zone_t g_zones[KEYMAP_MAX_ZONES];
+static uint32_t g_zone_count = 0u;
+
+// Velocity -> band, then note x band -> zone index (KEYMAP_NO_ZONE if uncovered).
+static uint8_t g_velocity_layer[128];
+static uint8_t g_zone_table[128][KEYMAP_MAX_LAYERS];
+static bool g_built = false;
+
+void keymap_clear() {
+    g_zone_count = 0u;
+    g_built = false;
+    std::memset(g_velocity_layer, 0, sizeof(g_velocity_layer));
+    std::memset(g_zone_table, KEYMAP_NO_ZONE, sizeof(g_zone_table));
+}
+
+keymap_line_t keymap_parse_line(const char *line, keymap_zone_t *zone) {
+    while (*line == ' ' || *line == '\t') {
+        ++line;
+    }
+    if (*line == '\0' || *line == '#' || *line == '\r' || *line == '\n') {
+        return KEYMAP_LINE_BLANK;
+    }
+
+    int low_note, high_note, low_velocity, high_velocity, root_note, tune_cents;
+    int path_start = 0;
+    if (std::sscanf(line, "%d %d %d %d %d %d %n", &low_note, &high_note, &low_velocity, &high_velocity, &root_note,
+                    &tune_cents, &path_start) != 6 || path_start == 0) {
+        return KEYMAP_LINE_INVALID;
+    }
+
+    const char *path = line + path_start;
+    const size_t path_length = std::strcspn(path, " \t\r\n");
+    if (path_length == 0u || path_length >= SAMPLE_CACHE_PATH_MAX) {
+        return KEYMAP_LINE_INVALID;
+    }
+
+    if (low_note < 0 || low_note > high_note || high_note > 127 ||
+        low_velocity < 0 || low_velocity > high_velocity || high_velocity > 127 ||
+        root_note < 0 || root_note > 127 || tune_cents < -1200 || tune_cents > 1200) {
+        return KEYMAP_LINE_INVALID;
+    }
+
+    std::memset(zone, 0, sizeof(*zone));
+    std::memcpy(zone->path, path, path_length);
+    zone->low_note = static_cast<uint8_t>(low_note);
+    zone->high_note = static_cast<uint8_t>(high_note);
+    zone->low_velocity = static_cast<uint8_t>(low_velocity);
+    zone->high_velocity = static_cast<uint8_t>(high_velocity);
+    zone->root_note = static_cast<uint8_t>(root_note);
+    zone->tune_cents = static_cast<int16_t>(tune_cents);
+    zone->tune_q16 = static_cast<uint32_t>(std::lround(65536.0 * std::exp2(tune_cents / 1200.0)));
+    return KEYMAP_LINE_ZONE;
+}
+
+bool keymap_add_zone(const keymap_zone_t *zone) {
+    if (g_zone_count >= KEYMAP_MAX_ZONES) {
+        return false;
+    }
+    g_zones[g_zone_count++] = *zone;
+    return true;
+}
+
+bool keymap_build() {
+    g_built = false;
+    if (g_zone_count == 0u) {
+        return false;
+    }
+
+    // A new velocity band starts at every zone's low edge and just past its high edge.
+    bool band_starts[129] = {};
+    band_starts[0] = true;
+    for (uint32_t i = 0; i < g_zone_count; ++i) {
+        band_starts[g_zones[i].low_velocity] = true;
+        band_starts[g_zones[i].high_velocity + 1u] = true;
+    }
+
+    uint32_t layer = 0u;
+    for (uint32_t velocity = 0; velocity < 128u; ++velocity) {
+        if (velocity > 0u && band_starts[velocity]) {
+            ++layer;
+        }
+        if (layer >= KEYMAP_MAX_LAYERS) {
+            printf("Keymap splits velocity into more than %u bands\n", KEYMAP_MAX_LAYERS);
+            return false;
+        }
+        g_velocity_layer[velocity] = static_cast<uint8_t>(layer);
+    }
+
+    // Fill last zone first so earlier zones overwrite it where they overlap.
+    std::memset(g_zone_table, KEYMAP_NO_ZONE, sizeof(g_zone_table));
+    for (uint32_t i = g_zone_count; i-- > 0u;) {
+        const keymap_zone_t &zone = g_zones[i];
+        const uint32_t first_layer = g_velocity_layer[zone.low_velocity];
+        const uint32_t last_layer = g_velocity_layer[zone.high_velocity];
+        for (uint32_t note = zone.low_note; note <= zone.high_note; ++note) {
+            for (uint32_t l = first_layer; l <= last_layer; ++l) {
+                g_zone_table[note][l] = static_cast<uint8_t>(i);
+            }
+        }
+    }
+
+    g_built = true;
+    return true;
+}
+
+const keymap_zone_t *keymap_lookup(uint8_t note, uint8_t velocity) {
+    if (!g_built || note > 127u || velocity > 127u) {
+        return nullptr;
+    }
+
+    const uint8_t index = g_zone_table[note][g_velocity_layer[velocity]];
+    return index == KEYMAP_NO_ZONE ? nullptr : &g_zones[index];
+}
+
+uint32_t keymap_zone_count() {
+    return g_zone_count;
+}
+
+const keymap_zone_t *keymap_zone(uint32_t index) {
+    return index < g_zone_count ? &g_zones[index] : nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+
+#include "sample_cache.h"
+
+// Maps MIDI note and velocity ranges to sample files. Zones come from a text
+// manifest, one per line:
+//
+//   # low high vlow vhigh root cents path
+//   21  47   1    80    36   0     0:/piano/c2_soft.mps
+//   21  47   81   127   36   0     0:/piano/c2_hard.mps
+//
+// Ranges are inclusive. `root` is the note the sample was recorded at and `cents`
+// fine-tunes it (-1200..1200). A path such as "synth:saw" plays a built-in wavetable
+// waveform instead of a file (see wavetable.h); those zones sound at concert pitch,
+// so their root is ignored. Where zones overlap, the one listed first wins.
+// keymap_build() turns the zones into a note x velocity-layer table, so a lookup is
+// two array reads no matter how many zones there are.
+#define KEYMAP_MAX_ZONES 64
+#define KEYMAP_MAX_LAYERS 16  // Distinct velocity bands across all zones.
+#define KEYMAP_NO_ZONE 0xffu
+
+typedef struct keymap_zone {
+    char path[SAMPLE_CACHE_PATH_MAX];
+    uint8_t low_note;
+    uint8_t high_note;
+    uint8_t low_velocity;
+    uint8_t high_velocity;
+    uint8_t root_note;
+    int16_t tune_cents;
+    uint32_t tune_q16;  // 2^(tune_cents / 1200) in Q16, applied to the pitch step.
+} keymap_zone_t;
+
+typedef enum keymap_line {
+    KEYMAP_LINE_BLANK = 0,  // Empty or a # comment.
+    KEYMAP_LINE_ZONE,
+    KEYMAP_LINE_INVALID,
+} keymap_line_t;
+
+void keymap_clear(void);
+
+keymap_line_t keymap_parse_line(const char *line, keymap_zone_t *zone);
+
+// Returns false once KEYMAP_MAX_ZONES zones have been added.
+bool keymap_add_zone(const keymap_zone_t *zone);
+
+// Builds the lookup table from the zones added since keymap_clear(). Returns false
+// if there are no zones or they split velocity into more than KEYMAP_MAX_LAYERS bands.
+bool keymap_build(void);
+
+// Zone for `note` played at `velocity`, or nullptr if no zone covers it.
+const keymap_zone_t *keymap_lookup(uint8_t note, uint8_t velocity);
+
+uint32_t keymap_zone_count(void);
+
+const keymap_zone_t *keymap_zone(uint32_t index);
+
+#endif  // KEYMAP_H
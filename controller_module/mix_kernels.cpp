@@ -0,0 +1,150 @@
+#include "mix_kernels.h"
+
+#include <cstring>
+
+#include "i2s_frame.h"
+
+#if MIX_KERNELS_USE_DSP
+#include <arm_acle.h>
+#endif
+
+static inline int16_t saturate_s16(int32_t value) {
+#if MIX_KERNELS_USE_DSP
+    return static_cast<int16_t>(__ssat(value, 16));
+#else
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return static_cast<int16_t>(value);
+#endif
+}
+
+void mix_accumulate_frames(int32_t *bus, const uint32_t *frames, uint32_t frame_count, int32_t gain_q15) {
+#if MIX_KERNELS_USE_DSP
+    // SMULWT/SMULWB multiply a 32-bit value by one halfword and keep the top 32 bits
+    // of the 48-bit product, so a gain in Q(16 + MIX_BUS_FRAC_BITS) lands straight at
+    // bus scale with no unpacking of the frame.
+    const int32_t gain_bus = gain_q15 << (MIX_BUS_FRAC_BITS + 1);
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        const int32_t frame = static_cast<int32_t>(frames[i]);
+        bus[i * 2u] += __smulwt(gain_bus, frame);
+        bus[i * 2u + 1u] += __smulwb(gain_bus, frame);
+    }
+#else
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        const uint32_t frame = frames[i];
+        bus[i * 2u] += (i2s_frame_left(frame) * gain_q15) >> (15 - MIX_BUS_FRAC_BITS);
+        bus[i * 2u + 1u] += (i2s_frame_right(frame) * gain_q15) >> (15 - MIX_BUS_FRAC_BITS);
+    }
+#endif
+}
+
+void mix_accumulate_frames_ramp(int32_t *bus, const uint32_t *frames, uint32_t frame_count, int32_t gain_q30,
+                                int32_t gain_step_q30) {
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        const int32_t gain_bus = gain_q30 >> (14 - MIX_BUS_FRAC_BITS);
+#if MIX_KERNELS_USE_DSP
+        const int32_t frame = static_cast<int32_t>(frames[i]);
+        bus[i * 2u] += __smulwt(gain_bus, frame);
+        bus[i * 2u + 1u] += __smulwb(gain_bus, frame);
+#else
+        const uint32_t frame = frames[i];
+        bus[i * 2u] += static_cast<int32_t>((static_cast<int64_t>(i2s_frame_left(frame)) * gain_bus) >> 16);
+        bus[i * 2u + 1u] += static_cast<int32_t>((static_cast<int64_t>(i2s_frame_right(frame)) * gain_bus) >> 16);
+#endif
+        gain_q30 += gain_step_q30;
+    }
+}
+
+// Numerical Recipes LCG; the top bits are the random ones.
+static inline uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed;
+}
+
+// Bus sample times the master gain, with `shift` fractional bits left to drop:
+// rounded, dithered at the new least significant bit if enabled, then shifted.
+static inline int32_t output_sample(int32_t bus, mix_output_t *output, uint32_t channel, uint32_t shift) {
+    int64_t value = static_cast<int64_t>(bus) * output->gain_q15 + (static_cast<int64_t>(1) << (shift - 1u));
+    if (output->dither) {
+        const int32_t random = static_cast<int32_t>(next_random(&output->seed) >> (32u - shift));
+        value += random - output->last_random[channel];
+        output->last_random[channel] = random;
+    }
+    value >>= shift;
+    if (value > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (value < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return static_cast<int32_t>(value);
+}
+
+void mix_output_frames(uint32_t *frames, const int32_t *bus, uint32_t frame_count, mix_output_t *output) {
+    const uint32_t shift = 15u + MIX_BUS_FRAC_BITS;
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        const int32_t left = output_sample(bus[i * 2u], output, 0u, shift);
+        const int32_t right = output_sample(bus[i * 2u + 1u], output, 1u, shift);
+        frames[i] = pack_i2s_frame(saturate_s16(left), saturate_s16(right));
+    }
+}
+
+static inline uint32_t saturate_s24_word(int32_t value) {
+#if MIX_KERNELS_USE_DSP
+    return static_cast<uint32_t>(__ssat(value, 24)) << 8u;
+#else
+    if (value > 0x7fffff) {
+        value = 0x7fffff;
+    } else if (value < -0x800000) {
+        value = -0x800000;
+    }
+    return static_cast<uint32_t>(value) << 8u;
+#endif
+}
+
+void mix_output_words32(uint32_t *words, const int32_t *bus, uint32_t frame_count, mix_output_t *output) {
+    // Down to 24 bits rather than 16.
+    const uint32_t shift = 15u + MIX_BUS_FRAC_BITS - (24u - 16u);
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        words[i * 2u] = saturate_s24_word(output_sample(bus[i * 2u], output, 0u, shift));
+        words[i * 2u + 1u] = saturate_s24_word(output_sample(bus[i * 2u + 1u], output, 1u, shift));
+    }
+}
+
+// Unsigned 8-bit samples become signed 16-bit by flipping the top bit and moving the
+// byte into the high half of the halfword. Both loops work on four bytes per word.
+
+void mix_expand_u8_mono_to_frames(uint32_t *frames, const uint8_t *pcm, uint32_t frame_count) {
+    uint32_t i = 0;
+    for (; i + 4u <= frame_count; i += 4u) {
+        uint32_t word;
+        std::memcpy(&word, pcm + i, sizeof(word));
+        word ^= 0x80808080u;
+        frames[i] = ((word & 0x000000ffu) << 8u) * 0x10001u;
+        frames[i + 1u] = (word & 0x0000ff00u) * 0x10001u;
+        frames[i + 2u] = ((word & 0x00ff0000u) >> 8u) * 0x10001u;
+        frames[i + 3u] = ((word & 0xff000000u) >> 16u) * 0x10001u;
+    }
+    for (; i < frame_count; ++i) {
+        frames[i] = (static_cast<uint32_t>(pcm[i] ^ 0x80u) << 8u) * 0x10001u;
+    }
+}
+
+void mix_expand_u8_stereo_to_frames(uint32_t *frames, const uint8_t *pcm, uint32_t frame_count) {
+    uint32_t i = 0;
+    for (; i + 2u <= frame_count; i += 2u) {
+        uint32_t word;
+        std::memcpy(&word, pcm + i * 2u, sizeof(word));
+        word ^= 0x80808080u;
+        frames[i] = ((word & 0x000000ffu) << 24u) | (word & 0x0000ff00u);
+        frames[i + 1u] = ((word & 0x00ff0000u) << 8u) | ((word & 0xff000000u) >> 16u);
+    }
+    for (; i < frame_count; ++i) {
+        frames[i] = (static_cast<uint32_t>(pcm[i * 2u] ^ 0x80u) << 24u) |
+                    (static_cast<uint32_t>(pcm[i * 2u + 1u] ^ 0x80u) << 8u);
+    }
+}
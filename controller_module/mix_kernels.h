@@ -0,0 +1,52 @@
+#ifndef MIX_KERNELS_H
+#define MIX_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Inner loops of the voice mixer. On cores with the ARMv8-M DSP extension (the
+// RP2350's Cortex-M33) these use the halfword multiply and saturate instructions;
+// everywhere else a portable C version with identical results is compiled.
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#define MIX_KERNELS_USE_DSP 1
+#else
+#define MIX_KERNELS_USE_DSP 0
+#endif
+
+// The mix bus is interleaved left/right int32 with MIX_BUS_FRAC_BITS bits below the
+// 16-bit sample scale, so each voice's gain product is kept to 24 bits instead of
+// being truncated to 16. A full-scale voice at unity gain spans +/-2^23, leaving
+// room for 256 of them before the bus wraps; the level is only brought back into
+// the output range, once, by the output stage.
+#define MIX_BUS_FRAC_BITS 8
+
+// bus[2i], bus[2i + 1] += left/right of frames[i] scaled by a Q15 gain.
+void mix_accumulate_frames(int32_t *bus, const uint32_t *frames, uint32_t frame_count, int32_t gain_q15);
+
+// As mix_accumulate_frames(), with a Q30 gain that moves by `gain_step_q30` per frame.
+void mix_accumulate_frames_ramp(int32_t *bus, const uint32_t *frames, uint32_t frame_count, int32_t gain_q30,
+                                int32_t gain_step_q30);
+
+// Output stage: the master gain and, optionally, TPDF dither at the output's least
+// significant bit, applied to the whole bus just before it is saturated to the
+// output width. The dither is the difference of successive uniform random values,
+// which is triangular and costs one random number per sample.
+typedef struct mix_output {
+    uint16_t gain_q15;  // 0x8000 is unity; up to 0xffff boosts by almost 2x.
+    bool dither;
+    uint32_t seed;
+    int32_t last_random[2];
+} mix_output_t;
+
+// Scales, dithers and saturates the bus to 16 bits and packs it into I2S frames.
+void mix_output_frames(uint32_t *frames, const int32_t *bus, uint32_t frame_count, mix_output_t *output);
+
+// As mix_output_frames() for 32-bit I2S slots: two words per frame, left then right,
+// each a 24-bit sample left-justified in the word.
+void mix_output_words32(uint32_t *words, const int32_t *bus, uint32_t frame_count, mix_output_t *output);
+
+// Expands unsigned 8-bit PCM into packed I2S frames (mono is duplicated to both sides).
+void mix_expand_u8_mono_to_frames(uint32_t *frames, const uint8_t *pcm, uint32_t frame_count);
+void mix_expand_u8_stereo_to_frames(uint32_t *frames, const uint8_t *pcm, uint32_t frame_count);
+
+#endif  // MIX_KERNELS_H
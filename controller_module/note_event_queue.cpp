@@ -0,0 +1,39 @@
+#include "note_event_queue.h"
+
+// head and tail run freely and are masked on access, so tail - head is always the
+// number of queued events, even across wrap-around.
+
+void note_event_queue_init(note_event_queue_t *queue) {
+    queue->head.store(0u);
+    queue->tail.store(0u);
+    queue->dropped = 0u;
+}
+
+bool note_event_queue_push(note_event_queue_t *queue, const note_event_t *event) {
+    const uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head.load(std::memory_order_acquire) == NOTE_EVENT_QUEUE_SIZE) {
+        ++queue->dropped;
+        return false;
+    }
+
+    queue->events[tail & (NOTE_EVENT_QUEUE_SIZE - 1u)] = *event;
+    // Publish the event before the consumer can see the new tail.
+    queue->tail.store(tail + 1u, std::memory_order_release);
+    return true;
+}
+
+bool note_event_queue_peek(note_event_queue_t *queue, note_event_t *event) {
+    const uint32_t head = queue->head.load(std::memory_order_relaxed);
+    if (head == queue->tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    *event = queue->events[head & (NOTE_EVENT_QUEUE_SIZE - 1u)];
+    return true;
+}
+
+void note_event_queue_pop(note_event_queue_t *queue) {
+    const uint32_t head = queue->head.load(std::memory_order_relaxed);
+    // The slot may be refilled by the producer as soon as head moves past it.
+    queue->head.store(head + 1u, std::memory_order_release);
+}
@@ -0,0 +1,41 @@
+#ifndef NOTE_EVENT_QUEUE_H
+#define NOTE_EVENT_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Single-producer/single-consumer ring carrying key events from the CAN receive
+// loop on core 0 to the renderer on core 1. Each side only writes its own index,
+// so neither ever waits on the other; a full ring drops the new event.
+#define NOTE_EVENT_QUEUE_SIZE 64u  // Must be a power of two.
+
+typedef enum note_event_type {
+    NOTE_EVENT_ON = 0,
+    NOTE_EVENT_OFF,
+} note_event_type_t;
+
+typedef struct note_event {
+    uint32_t time_us;  // time_us_32() when the event was received.
+    uint8_t type;      // note_event_type_t
+    uint8_t note;
+    uint8_t velocity;
+} note_event_t;
+
+typedef struct note_event_queue {
+    note_event_t events[NOTE_EVENT_QUEUE_SIZE];
+    std::atomic<uint32_t> head;  // Next event to read; written by the consumer.
+    std::atomic<uint32_t> tail;  // Next slot to fill; written by the producer.
+    uint32_t dropped;            // Producer only.
+} note_event_queue_t;
+
+void note_event_queue_init(note_event_queue_t *queue);
+
+// Producer side. Returns false (and counts a drop) if the ring is full.
+bool note_event_queue_push(note_event_queue_t *queue, const note_event_t *event);
+
+// Consumer side: copies the oldest event without removing it, so the renderer can
+// leave events that belong to a later block in place.
+bool note_event_queue_peek(note_event_queue_t *queue, note_event_t *event);
+void note_event_queue_pop(note_event_queue_t *queue);
+
+#endif  // NOTE_EVENT_QUEUE_H
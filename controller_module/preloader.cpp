@@ -0,0 +1,211 @@
+#include "preloader.h"
+
+#include <atomic>
+#include <cstring>
+
+#include "sample_cache.h"
+#include "wavetable.h"
+
+typedef enum zone_load_state {
+    ZONE_PENDING = 0,
+    ZONE_LOADING,
+    ZONE_LOADED,
+    ZONE_FAILED,
+} zone_load_state_t;
+
+// Zone indices in load order, and how far through it boot preloading has got.
+static uint8_t g_order[KEYMAP_MAX_ZONES];
+static uint32_t g_order_count = 0u;
+static uint32_t g_next = 0u;
+
+static volatile uint8_t g_zone_state[KEYMAP_MAX_ZONES];
+static int32_t g_loading_zone = -1;
+static bool g_loading_on_demand = false;
+
+// Per key: is it mapped at all, and how many of its zones are still to load.
+static bool g_key_mapped[128];
+static volatile uint8_t g_key_pending[128];
+static std::atomic<uint32_t> g_ready_keys;
+
+static std::atomic<uint32_t> g_requested_zone;  // Zone index + 1; 0 when none.
+
+// Distance in semitones from the middle octaves; zones touching them come first.
+static uint32_t zone_priority(const keymap_zone_t *zone) {
+    if (zone->high_note < PRELOAD_MIDDLE_LOW_NOTE) {
+        return PRELOAD_MIDDLE_LOW_NOTE - zone->high_note;
+    }
+    if (zone->low_note > PRELOAD_MIDDLE_HIGH_NOTE) {
+        return zone->low_note - PRELOAD_MIDDLE_HIGH_NOTE;
+    }
+    return 0u;
+}
+
+void preloader_init() {
+    g_order_count = keymap_zone_count();
+    g_next = 0u;
+    g_loading_zone = -1;
+    g_loading_on_demand = false;
+    g_ready_keys.store(0u);
+    g_requested_zone.store(0u);
+    for (uint32_t i = 0; i < KEYMAP_MAX_ZONES; ++i) {
+        g_zone_state[i] = ZONE_PENDING;
+    }
+    std::memset(g_key_mapped, 0, sizeof(g_key_mapped));
+
+    for (uint32_t note = 0; note < 128u; ++note) {
+        g_key_pending[note] = 0u;
+    }
+
+    // Stable insertion sort, so equally central zones keep their manifest order.
+    for (uint32_t i = 0; i < g_order_count; ++i) {
+        const uint32_t priority = zone_priority(keymap_zone(i));
+        uint32_t j = i;
+        while (j > 0u && zone_priority(keymap_zone(g_order[j - 1u])) > priority) {
+            g_order[j] = g_order[j - 1u];
+            --j;
+        }
+        g_order[j] = static_cast<uint8_t>(i);
+
+        // Synth zones have nothing to load.
+        const keymap_zone_t *zone = keymap_zone(i);
+        wavetable_waveform_t waveform;
+        const bool synth = wavetable_parse_path(zone->path, &waveform);
+        if (synth) {
+            g_zone_state[i] = ZONE_LOADED;
+        }
+        for (uint32_t note = zone->low_note; note <= zone->high_note; ++note) {
+            g_key_mapped[note] = true;
+            if (!synth) {
+                g_key_pending[note] = static_cast<uint8_t>(g_key_pending[note] + 1u);
+            }
+        }
+    }
+
+    for (uint32_t note = 0; note < 128u; ++note) {
+        if (g_key_mapped[note] && g_key_pending[note] == 0u) {
+            g_ready_keys.fetch_add(1u);
+        }
+    }
+}
+
+// Zones that share a sample file land together.
+static void mark_loaded(uint32_t index) {
+    const char *path = keymap_zone(index)->path;
+    for (uint32_t i = 0; i < g_order_count; ++i) {
+        const keymap_zone_t *zone = keymap_zone(i);
+        if (g_zone_state[i] == ZONE_LOADED || (i != index && std::strcmp(zone->path, path) != 0)) {
+            continue;
+        }
+
+        g_zone_state[i] = ZONE_LOADED;
+        for (uint32_t note = zone->low_note; note <= zone->high_note; ++note) {
+            g_key_pending[note] = static_cast<uint8_t>(g_key_pending[note] - 1u);
+            if (g_key_pending[note] == 0u) {
+                g_ready_keys.fetch_add(1u);
+            }
+        }
+    }
+}
+
+static void start_zone(uint32_t index, bool allow_evict) {
+    const sample_cache_entry_t *entry = sample_cache_begin_load(keymap_zone(index)->path, allow_evict);
+    if (!entry) {
+        // A boot preload that does not fit stays pending for an on-demand request.
+        if (allow_evict) {
+            g_zone_state[index] = ZONE_FAILED;
+        }
+        return;
+    }
+
+    if (entry->frames_ready.load() == entry->frame_count) {
+        mark_loaded(index);
+    } else {
+        g_zone_state[index] = ZONE_LOADING;
+        g_loading_zone = static_cast<int32_t>(index);
+        g_loading_on_demand = allow_evict;
+    }
+}
+
+// Takes the on-demand request, if there is one and it may start now. A boot load
+// in progress is suspended for it and picked up again once the queue comes back
+// round to it; an on-demand load is never interrupted.
+static uint32_t take_request() {
+    if (g_loading_zone >= 0 && g_loading_on_demand) {
+        return 0u;
+    }
+
+    const uint32_t requested = g_requested_zone.exchange(0u);
+    if (requested == 0u || requested > g_order_count) {
+        return 0u;
+    }
+    if (g_loading_zone >= 0) {
+        if (requested - 1u == static_cast<uint32_t>(g_loading_zone)) {
+            g_loading_on_demand = true;
+            return 0u;
+        }
+        // Boot loads only start from the queue, so the zone is the one just behind g_next.
+        sample_cache_suspend_load();
+        g_zone_state[g_loading_zone] = ZONE_PENDING;
+        g_loading_zone = -1;
+        --g_next;
+    }
+    return requested;
+}
+
+bool preloader_step(uint32_t max_frames) {
+    // On-demand requests jump the queue and may reload a sample evicted since boot.
+    const uint32_t requested = take_request();
+    if (requested != 0u) {
+        start_zone(requested - 1u, true);
+        return true;
+    }
+
+    if (g_loading_zone >= 0) {
+        const sample_cache_load_result_t result = sample_cache_load_step(max_frames);
+        if (result == SAMPLE_CACHE_LOAD_MORE) {
+            return true;
+        }
+
+        if (result == SAMPLE_CACHE_LOAD_DONE) {
+            mark_loaded(static_cast<uint32_t>(g_loading_zone));
+        } else {
+            g_zone_state[g_loading_zone] = ZONE_FAILED;
+        }
+        g_loading_zone = -1;
+        return true;
+    }
+
+    while (g_next < g_order_count) {
+        const uint32_t index = g_order[g_next++];
+        if (g_zone_state[index] == ZONE_PENDING) {
+            start_zone(index, false);
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zone_index(const keymap_zone_t *zone) {
+    return static_cast<uint32_t>(zone - keymap_zone(0u));
+}
+
+void preloader_request(const keymap_zone_t *zone) {
+    g_requested_zone.store(zone_index(zone) + 1u);
+}
+
+bool preloader_zone_loading(const keymap_zone_t *zone) {
+    const uint32_t index = zone_index(zone);
+    return g_zone_state[index] == ZONE_LOADING || g_requested_zone.load() == index + 1u;
+}
+
+bool preloader_zone_failed(const keymap_zone_t *zone) {
+    return g_zone_state[zone_index(zone)] == ZONE_FAILED;
+}
+
+bool preloader_key_ready(uint8_t note) {
+    return note < 128u && g_key_mapped[note] && g_key_pending[note] == 0u;
+}
+
+uint32_t preloader_ready_key_count() {
+    return g_ready_keys.load();
+}
@@ -0,0 +1,43 @@
+#ifndef PRELOADER_H
+#define PRELOADER_H
+
+#include <stdint.h>
+
+#include "keymap.h"
+
+// Pulls the keymap's samples into the sample cache in the background, middle
+// octaves first, so the keyboard becomes playable from the centre outwards while
+// the rest of the library is still loading. Runs on the loading thread in small
+// steps; each step reads at most one chunk so the caller stays responsive.
+//
+// Boot preloading never evicts. Zones that do not fit are left for
+// preloader_request(), which may evict idle samples to load a key on demand.
+#define PRELOAD_MIDDLE_LOW_NOTE 48   // C3
+#define PRELOAD_MIDDLE_HIGH_NOTE 72  // C5
+
+// Orders the current keymap's zones by priority and marks every key not ready.
+void preloader_init(void);
+
+// Loads up to `max_frames` more frames. Returns false once there is nothing left
+// to do (until the next preloader_request()).
+bool preloader_step(uint32_t max_frames);
+
+// Asks the loading thread to load `zone` next, evicting if needed. A boot preload
+// in progress is suspended for it. Safe to call from the other core; a newer
+// request replaces one not yet started.
+void preloader_request(const keymap_zone_t *zone);
+
+// True while `zone` is loading or requested and waiting to start. Safe to call from
+// the other core.
+bool preloader_zone_loading(const keymap_zone_t *zone);
+
+// True once loading `zone` has failed, on demand or part way through; it is not
+// retried. Safe to call from the other core.
+bool preloader_zone_failed(const keymap_zone_t *zone);
+
+// True once every zone covering `note` has been loaded. Safe to call from the other core.
+bool preloader_key_ready(uint8_t note);
+
+uint32_t preloader_ready_key_count(void);
+
+#endif  // PRELOADER_H
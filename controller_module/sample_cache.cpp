@@ -0,0 +1,269 @@
+#include "sample_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "adpcm.h"
+
+static sample_cache_entry_t g_entries[SAMPLE_CACHE_MAX_ENTRIES];
+static sample_cache_loader_t g_loader = {};
+static sample_cache_stats_t g_stats;
+static uint32_t g_use_tick = 0u;
+static spin_lock_t *g_lock = nullptr;
+
+// The entry being filled by sample_cache_load_step(); touched by the loading thread only.
+static sample_cache_entry_t *g_loading = nullptr;
+
+// All of the helpers below run with g_lock held.
+
+static bool entry_in_use(const sample_cache_entry_t *entry) {
+    return entry->data != nullptr;
+}
+
+static size_t entry_bytes(const sample_cache_entry_t *entry) {
+    return sample_storage_bytes(entry->encoding, entry->frame_count);
+}
+
+static sample_cache_entry_t *find_entry(const char *path) {
+    for (sample_cache_entry_t &entry : g_entries) {
+        if (entry_in_use(&entry) && std::strcmp(entry.path, path) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Unlinks the least recently used entry nobody is playing and returns its data for
+// the caller to free once the lock is dropped. New references are only taken under
+// the lock, so an entry seen at zero here cannot be picked up concurrently.
+static void *evict_one() {
+    sample_cache_entry_t *victim = nullptr;
+    for (sample_cache_entry_t &entry : g_entries) {
+        if (!entry_in_use(&entry) || &entry == g_loading || entry.ref_count.load() != 0u) {
+            continue;
+        }
+        if (!victim || entry.last_used < victim->last_used) {
+            victim = &entry;
+        }
+    }
+
+    if (!victim) {
+        return nullptr;
+    }
+
+    void *data = victim->data;
+    g_stats.bytes_used -= entry_bytes(victim);
+    --g_stats.entry_count;
+    ++g_stats.evictions;
+    victim->data = nullptr;
+    victim->path[0] = '\0';
+    return data;
+}
+
+static sample_cache_entry_t *find_free_slot() {
+    for (sample_cache_entry_t &entry : g_entries) {
+        if (!entry_in_use(&entry)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void sample_cache_init(size_t budget_bytes, const sample_cache_loader_t *loader) {
+    if (!g_lock) {
+        g_lock = spin_lock_init(spin_lock_claim_unused(true));
+    }
+
+    for (sample_cache_entry_t &entry : g_entries) {
+        if (entry_in_use(&entry)) {
+            std::free(entry.data);
+        }
+        entry.path[0] = '\0';
+        entry.data = nullptr;
+        entry.frame_count = 0u;
+        entry.frames_ready.store(0u);
+        entry.ref_count.store(0u);
+    }
+
+    std::memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.budget_bytes = budget_bytes;
+    g_loader = *loader;
+    g_use_tick = 0u;
+    g_loading = nullptr;
+}
+
+const sample_cache_entry_t *sample_cache_acquire(const char *path) {
+    uint32_t save = spin_lock_blocking(g_lock);
+    sample_cache_entry_t *entry = find_entry(path);
+    if (entry) {
+        ++g_stats.hits;
+        entry->last_used = ++g_use_tick;
+        entry->ref_count.fetch_add(1u);
+    } else {
+        ++g_stats.misses;
+    }
+    spin_unlock(g_lock, save);
+    return entry;
+}
+
+void sample_cache_release(const sample_cache_entry_t *entry) {
+    if (entry) {
+        const_cast<sample_cache_entry_t *>(entry)->ref_count.fetch_sub(1u);
+    }
+}
+
+// Makes room for `byte_count` more bytes and a free slot. Frees outside the lock so
+// the other core is never held up by the allocator.
+static bool make_room(size_t byte_count, bool allow_evict) {
+    while (true) {
+        uint32_t save = spin_lock_blocking(g_lock);
+        const bool fits = g_stats.bytes_used + byte_count <= g_stats.budget_bytes && find_free_slot();
+        void *evicted = fits || !allow_evict ? nullptr : evict_one();
+        spin_unlock(g_lock, save);
+
+        if (fits) {
+            return true;
+        }
+        if (!evicted) {
+            return false;
+        }
+        std::free(evicted);
+    }
+}
+
+// Voices may already be streaming from a load that fails, so its entry cannot be
+// freed here. Pads it with silence and hides it; it is evicted first once idle.
+// All-zero ADPCM blocks decode to silence too.
+static void abandon_load(sample_cache_entry_t *entry) {
+    const size_t ready_bytes =
+        sample_storage_bytes(entry->encoding, entry->frames_ready.load(std::memory_order_relaxed));
+    std::memset(static_cast<uint8_t *>(entry->data) + ready_bytes, 0, entry_bytes(entry) - ready_bytes);
+    uint32_t save = spin_lock_blocking(g_lock);
+    entry->path[0] = '\0';
+    entry->last_used = 0u;
+    spin_unlock(g_lock, save);
+    entry->frames_ready.store(entry->frame_count, std::memory_order_release);
+}
+
+// Reopens a suspended load at the frame it stopped on.
+static const sample_cache_entry_t *resume_load(sample_cache_entry_t *entry) {
+    sample_frames_t sample = {};
+    if (!g_loader.open(entry->path, &sample)) {
+        abandon_load(entry);
+        return nullptr;
+    }
+    if (sample.encoding != entry->encoding || sample.frame_count != entry->frame_count ||
+        !g_loader.seek(entry->frames_ready.load(std::memory_order_relaxed))) {
+        printf("Failed to resume sample load: %s\n", entry->path);
+        g_loader.close();
+        abandon_load(entry);
+        return nullptr;
+    }
+
+    g_loading = entry;
+    return entry;
+}
+
+const sample_cache_entry_t *sample_cache_begin_load(const char *path, bool allow_evict) {
+    if (g_loading || std::strlen(path) >= SAMPLE_CACHE_PATH_MAX) {
+        return nullptr;
+    }
+
+    uint32_t save = spin_lock_blocking(g_lock);
+    sample_cache_entry_t *existing = find_entry(path);
+    spin_unlock(g_lock, save);
+    if (existing) {
+        // Only the loading thread fills entries, so one short of its frame count
+        // here was suspended.
+        if (existing->frames_ready.load(std::memory_order_relaxed) != existing->frame_count) {
+            return resume_load(existing);
+        }
+        return existing;
+    }
+
+    sample_frames_t sample = {};
+    if (!g_loader.open(path, &sample)) {
+        return nullptr;
+    }
+
+    const size_t byte_count = sample_storage_bytes(sample.encoding, sample.frame_count);
+    void *data = nullptr;
+    if (sample.frame_count == 0u || !make_room(byte_count, allow_evict) || !(data = std::malloc(byte_count))) {
+        g_loader.close();
+        return nullptr;
+    }
+
+    // Fill the slot before it becomes visible: an entry is in use once `data` is set.
+    save = spin_lock_blocking(g_lock);
+    sample_cache_entry_t *slot = find_free_slot();
+    std::strcpy(slot->path, path);
+    slot->encoding = sample.encoding;
+    slot->frame_count = sample.frame_count;
+    slot->sample_rate_hz = sample.sample_rate_hz;
+    slot->loop_start = sample.loop_start;
+    slot->loop_end = sample.loop_end;
+    slot->last_used = ++g_use_tick;
+    slot->frames_ready.store(0u);
+    slot->ref_count.store(0u);
+    slot->data = data;
+    g_stats.bytes_used += byte_count;
+    ++g_stats.entry_count;
+    spin_unlock(g_lock, save);
+
+    g_loading = slot;
+    return slot;
+}
+
+sample_cache_load_result_t sample_cache_load_step(uint32_t max_frames) {
+    sample_cache_entry_t *entry = g_loading;
+    if (!entry) {
+        return SAMPLE_CACHE_LOAD_IDLE;
+    }
+
+    const uint32_t ready = entry->frames_ready.load(std::memory_order_relaxed);
+    const uint32_t remaining = entry->frame_count - ready;
+    uint32_t count = remaining < max_frames ? remaining : max_frames;
+    // ADPCM is read in whole blocks so every loaded frame can be decoded.
+    if (entry->encoding != SAMPLE_ENCODING_FRAMES && count < remaining) {
+        count -= count % ADPCM_BLOCK_FRAMES;
+        if (count == 0u) {
+            count = ADPCM_BLOCK_FRAMES;
+        }
+    }
+
+    // `ready` is a whole number of ADPCM blocks until the load completes.
+    const size_t ready_bytes = sample_storage_bytes(entry->encoding, ready);
+    uint8_t *destination = static_cast<uint8_t *>(entry->data) + ready_bytes;
+    if (!g_loader.read(destination, count)) {
+        printf("Failed to load sample frames: %s\n", entry->path);
+        abandon_load(entry);
+        g_loader.close();
+        g_loading = nullptr;
+        return SAMPLE_CACHE_LOAD_FAILED;
+    }
+
+    // Publish the frames before the count that makes them readable.
+    entry->frames_ready.store(ready + count, std::memory_order_release);
+    if (ready + count < entry->frame_count) {
+        return SAMPLE_CACHE_LOAD_MORE;
+    }
+
+    g_loader.close();
+    g_loading = nullptr;
+    return SAMPLE_CACHE_LOAD_DONE;
+}
+
+void sample_cache_suspend_load() {
+    if (g_loading) {
+        g_loader.close();
+        g_loading = nullptr;
+    }
+}
+
+sample_cache_stats_t sample_cache_get_stats() {
+    uint32_t save = spin_lock_blocking(g_lock);
+    const sample_cache_stats_t stats = g_stats;
+    spin_unlock(g_lock, save);
+    return stats;
+}
@@ -0,0 +1,92 @@
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/sync.h"
+#include "i2s_frame.h"
+
+// RAM-resident cache of sample frames keyed by file path. Samples are kept in the
+// encoding they were stored in, so ADPCM samples stay compressed. Entries are
+// reference counted: a sample that is still playing is never evicted. Samples are
+// loaded a chunk at a time by a single loading thread, and an entry can be acquired
+// and played while it is still filling: frames below `frames_ready` are valid.
+//
+// The entry table is guarded by a spin lock, so the renderer may acquire and
+// release entries on the other core while a load is in progress.
+#define SAMPLE_CACHE_MAX_ENTRIES 32
+#define SAMPLE_CACHE_PATH_MAX 32
+
+// Reads samples for the cache. Only one sample is open at a time.
+typedef struct sample_cache_loader {
+    // Opens `path` and fills in everything in `sample` except `frames`.
+    bool (*open)(const char *path, sample_frames_t *sample);
+    // Reads the next `frame_count` frames of the open sample into `data`, in the
+    // encoding open() reported. ADPCM reads always start on a block boundary.
+    bool (*read)(void *data, uint32_t frame_count);
+    // Moves the open sample to `frame`, a whole number of ADPCM blocks, so a
+    // suspended load can carry on where it stopped.
+    bool (*seek)(uint32_t frame);
+    void (*close)(void);
+} sample_cache_loader_t;
+
+typedef struct sample_cache_entry {
+    char path[SAMPLE_CACHE_PATH_MAX];
+    void *data;  // sample_storage_bytes(encoding, frame_count) bytes.
+    sample_encoding_t encoding;
+    uint32_t frame_count;
+    uint32_t sample_rate_hz;
+    uint32_t loop_start;
+    uint32_t loop_end;
+    uint32_t last_used;
+    std::atomic<uint32_t> frames_ready;  // Reaches frame_count once the load completes.
+    std::atomic<uint32_t> ref_count;
+} sample_cache_entry_t;
+
+typedef struct sample_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entry_count;
+    size_t bytes_used;
+    size_t budget_bytes;
+} sample_cache_stats_t;
+
+typedef enum sample_cache_load_result {
+    SAMPLE_CACHE_LOAD_IDLE = 0,  // No load in progress.
+    SAMPLE_CACHE_LOAD_MORE,
+    SAMPLE_CACHE_LOAD_DONE,
+    SAMPLE_CACHE_LOAD_FAILED,
+} sample_cache_load_result_t;
+
+void sample_cache_init(size_t budget_bytes, const sample_cache_loader_t *loader);
+
+// Returns the entry for `path` with one reference taken, including one that is
+// still loading, or nullptr if it is not cached. Never calls the loader.
+const sample_cache_entry_t *sample_cache_acquire(const char *path);
+
+// Drops a reference taken by sample_cache_acquire(). Safe to call from an IRQ.
+void sample_cache_release(const sample_cache_entry_t *entry);
+
+// Loading thread only. Opens `path` and reserves its buffer; the entry is
+// visible to sample_cache_acquire() from here on. Returns the entry at once if it is
+// already cached, or resumes it if its load was suspended. Idle entries are evicted
+// to make room only if `allow_evict`.
+// Returns nullptr if another load is in progress or the sample cannot be opened or
+// does not fit.
+const sample_cache_entry_t *sample_cache_begin_load(const char *path, bool allow_evict);
+
+// Loading thread only. Reads up to `max_frames` more frames of the current load.
+// A failed load leaves its entry playing silence past the failure and uncached.
+sample_cache_load_result_t sample_cache_load_step(uint32_t max_frames);
+
+// Loading thread only. Closes the current load's file so another sample can be
+// loaded first. The entry stays cached with the frames read so far; voices playing
+// it wait at `frames_ready` until sample_cache_begin_load() resumes it.
+void sample_cache_suspend_load(void);
+
+sample_cache_stats_t sample_cache_get_stats(void);
+
+#endif  // SAMPLE_CACHE_H
@@ -0,0 +1,269 @@
+#include "sample_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "adpcm.h"
+#include "mix_kernels.h"
+
+// smpl chunk layout: a 36-byte header (loop count at +28) followed by 24-byte loop records.
+#define WAV_SMPL_HEADER_BYTES 36u
+#define WAV_SMPL_LOOP_BYTES 24u
+
+static inline uint16_t read_u16_le(const uint8_t *bytes) {
+    return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+static inline uint32_t read_u32_le(const uint8_t *bytes) {
+    return static_cast<uint32_t>(bytes[0]) |
+           (static_cast<uint32_t>(bytes[1]) << 8u) |
+           (static_cast<uint32_t>(bytes[2]) << 16u) |
+           (static_cast<uint32_t>(bytes[3]) << 24u);
+}
+
+static bool seek_forward(const sample_reader_t *reader, uint32_t byte_count) {
+    return reader->seek(reader->context, reader->tell(reader->context) + byte_count);
+}
+
+bool parse_wav(const sample_reader_t *reader, const char *name, wav_sample_t *sample) {
+    std::memset(sample, 0, sizeof(*sample));
+
+    uint8_t riff_header[12];
+    if (!reader->read(reader->context, riff_header, sizeof(riff_header))) {
+        printf("Failed to read WAV header: %s\n", name);
+        return false;
+    }
+
+    if (std::memcmp(riff_header, "RIFF", 4) != 0 || std::memcmp(riff_header + 8, "WAVE", 4) != 0) {
+        printf("Not a RIFF/WAVE file: %s\n", name);
+        return false;
+    }
+
+    bool found_fmt = false;
+    bool found_data = false;
+    uint32_t data_offset = 0;
+
+    while (reader->tell(reader->context) + 8u <= reader->size_bytes) {
+        uint8_t chunk_header[8];
+        if (!reader->read(reader->context, chunk_header, sizeof(chunk_header))) {
+            break;
+        }
+
+        const uint32_t chunk_size = read_u32_le(chunk_header + 4);
+        const uint32_t padded_chunk_size = chunk_size + (chunk_size & 1u);
+
+        if (std::memcmp(chunk_header, "fmt ", 4) == 0) {
+            if (chunk_size < 16u) {
+                printf("Invalid fmt chunk in %s\n", name);
+                return false;
+            }
+
+            uint8_t fmt_chunk[16];
+            if (!reader->read(reader->context, fmt_chunk, sizeof(fmt_chunk))) {
+                printf("Failed to read fmt chunk in %s\n", name);
+                return false;
+            }
+
+            sample->audio_format = read_u16_le(fmt_chunk + 0);
+            sample->channel_count = read_u16_le(fmt_chunk + 2);
+            sample->sample_rate_hz = read_u32_le(fmt_chunk + 4);
+            sample->byte_rate = read_u32_le(fmt_chunk + 8);
+            sample->block_align = read_u16_le(fmt_chunk + 12);
+            sample->bits_per_sample = read_u16_le(fmt_chunk + 14);
+
+            if (padded_chunk_size > sizeof(fmt_chunk) && !seek_forward(reader, padded_chunk_size - sizeof(fmt_chunk))) {
+                printf("Failed to skip fmt extension in %s\n", name);
+                return false;
+            }
+
+            found_fmt = true;
+        } else if (std::memcmp(chunk_header, "data", 4) == 0) {
+            sample->data_size_bytes = chunk_size;
+            data_offset = reader->tell(reader->context);
+            found_data = true;
+
+            // The smpl chunk usually follows the data, so skip it and seek back at the end.
+            if (!seek_forward(reader, padded_chunk_size)) {
+                printf("Failed to skip WAV data chunk in %s\n", name);
+                return false;
+            }
+        } else if (std::memcmp(chunk_header, "smpl", 4) == 0 && chunk_size >= WAV_SMPL_HEADER_BYTES + WAV_SMPL_LOOP_BYTES) {
+            // Only the first loop is used: start at +8 and inclusive end at +12 of the loop record.
+            uint8_t smpl_chunk[WAV_SMPL_HEADER_BYTES + WAV_SMPL_LOOP_BYTES];
+            if (!reader->read(reader->context, smpl_chunk, sizeof(smpl_chunk))) {
+                printf("Failed to read smpl chunk in %s\n", name);
+                return false;
+            }
+
+            if (read_u32_le(smpl_chunk + 28) > 0u) {
+                const uint8_t *loop = smpl_chunk + WAV_SMPL_HEADER_BYTES;
+                sample->loop_start = read_u32_le(loop + 8);
+                sample->loop_end = read_u32_le(loop + 12) + 1u;
+            }
+
+            if (!seek_forward(reader, padded_chunk_size - sizeof(smpl_chunk))) {
+                printf("Failed to skip smpl loops in %s\n", name);
+                return false;
+            }
+        } else {
+            if (!seek_forward(reader, padded_chunk_size)) {
+                printf("Failed to skip WAV chunk in %s\n", name);
+                return false;
+            }
+        }
+
+    }
+
+    if (!found_fmt || !found_data) {
+        printf("Missing fmt/data chunk in %s\n", name);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    if (sample->audio_format != 1u) {
+        printf("Unsupported WAV format %u in %s\n", sample->audio_format, name);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    if ((sample->channel_count != 1u && sample->channel_count != 2u) ||
+        (sample->bits_per_sample != 8u && sample->bits_per_sample != 16u) ||
+        sample->block_align != sample->channel_count * (sample->bits_per_sample / 8u) ||
+        sample->sample_rate_hz == 0u) {
+        printf("Unsupported WAV layout in %s\n", name);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    // A loop that does not fit inside the data is ignored rather than rejected.
+    const uint32_t frame_count = static_cast<uint32_t>(sample->data_size_bytes / sample->block_align);
+    if (sample->loop_start >= sample->loop_end || sample->loop_end > frame_count) {
+        sample->loop_start = 0u;
+        sample->loop_end = 0u;
+    }
+
+    if (!reader->seek(reader->context, data_offset)) {
+        printf("Failed to seek to WAV data: %s\n", name);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    return true;
+}
+
+sample_encoding_t native_sample_encoding(const native_sample_header_t *header) {
+    if (!(header->flags & NATIVE_SAMPLE_FLAG_ADPCM)) {
+        return SAMPLE_ENCODING_FRAMES;
+    }
+    return header->flags & NATIVE_SAMPLE_FLAG_MONO ? SAMPLE_ENCODING_ADPCM_MONO : SAMPLE_ENCODING_ADPCM_STEREO;
+}
+
+bool parse_native_sample(const sample_reader_t *reader, const char *name, native_sample_header_t *header) {
+    uint8_t bytes[NATIVE_SAMPLE_HEADER_BYTES];
+    if (!reader->read(reader->context, bytes, sizeof(bytes)) || std::memcmp(bytes, NATIVE_SAMPLE_MAGIC, 4) != 0) {
+        printf("Not a native sample file: %s\n", name);
+        return false;
+    }
+
+    header->version = read_u16_le(bytes + 4);
+    header->data_offset = read_u16_le(bytes + 6);
+    header->sample_rate_hz = read_u32_le(bytes + 8);
+    header->frame_count = read_u32_le(bytes + 12);
+    header->loop_start = read_u32_le(bytes + 16);
+    header->loop_end = read_u32_le(bytes + 20);
+    header->flags = read_u32_le(bytes + 24);
+
+    const uint32_t known_flags = NATIVE_SAMPLE_FLAG_ADPCM | NATIVE_SAMPLE_FLAG_MONO;
+    const bool flags_valid = (header->flags & ~known_flags) == 0u &&
+                             ((header->flags & NATIVE_SAMPLE_FLAG_ADPCM) || !(header->flags & NATIVE_SAMPLE_FLAG_MONO));
+    if (header->version != NATIVE_SAMPLE_VERSION || header->sample_rate_hz == 0u || !flags_valid ||
+        header->data_offset < NATIVE_SAMPLE_HEADER_BYTES ||
+        header->data_offset + static_cast<uint64_t>(sample_storage_bytes(native_sample_encoding(header),
+                                                                         header->frame_count)) > reader->size_bytes) {
+        printf("Unsupported native sample header in %s\n", name);
+        return false;
+    }
+
+    if (!reader->seek(reader->context, header->data_offset)) {
+        printf("Failed to seek to sample frames: %s\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+bool parse_sample(const sample_reader_t *reader, const char *name, bool *is_native,
+                  native_sample_header_t *native, wav_sample_t *wav) {
+    char magic[4];
+    if (!reader->read(reader->context, magic, sizeof(magic)) || !reader->seek(reader->context, 0u)) {
+        printf("Failed to read sample header: %s\n", name);
+        return false;
+    }
+
+    *is_native = std::memcmp(magic, NATIVE_SAMPLE_MAGIC, 4) == 0;
+    if (*is_native) {
+        return parse_native_sample(reader, name, native);
+    }
+    return parse_wav(reader, name, wav);
+}
+
+bool load_wav(const sample_reader_t *reader, const char *name, wav_sample_t *sample) {
+    if (!parse_wav(reader, name, sample)) {
+        return false;
+    }
+
+    uint8_t *raw_data = static_cast<uint8_t *>(std::malloc(sample->data_size_bytes));
+    if (!raw_data) {
+        printf("Out of memory loading WAV data: %s\n", name);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    if (!reader->read(reader->context, raw_data, static_cast<uint32_t>(sample->data_size_bytes))) {
+        printf("Failed to read WAV data: %s\n", name);
+        std::free(raw_data);
+        std::memset(sample, 0, sizeof(*sample));
+        return false;
+    }
+
+    sample->data = raw_data;
+    return true;
+}
+
+void convert_pcm_to_i2s_frames(const wav_sample_t &sample, const uint8_t *pcm, size_t frame_count, uint32_t *frames) {
+    if (sample.bits_per_sample == 16u) {
+        const int16_t *pcm16 = reinterpret_cast<const int16_t *>(pcm);
+        if (sample.channel_count == 1u) {
+            for (size_t i = 0; i < frame_count; ++i) {
+                frames[i] = pack_i2s_frame(pcm16[i], pcm16[i]);
+            }
+        } else {
+            for (size_t i = 0; i < frame_count; ++i) {
+                frames[i] = pack_i2s_frame(pcm16[i * 2u], pcm16[i * 2u + 1u]);
+            }
+        }
+    } else if (sample.channel_count == 1u) {
+        mix_expand_u8_mono_to_frames(frames, pcm, static_cast<uint32_t>(frame_count));
+    } else {
+        mix_expand_u8_stereo_to_frames(frames, pcm, static_cast<uint32_t>(frame_count));
+    }
+}
+
+bool build_i2s_frames(const wav_sample_t &sample, uint32_t **frames_out, size_t *frame_count_out) {
+    const size_t frame_count = sample.data_size_bytes / sample.block_align;
+    if (frame_count == 0u) {
+        return false;
+    }
+
+    uint32_t *frames = static_cast<uint32_t *>(std::malloc(frame_count * sizeof(uint32_t)));
+    if (!frames) {
+        return false;
+    }
+
+    convert_pcm_to_i2s_frames(sample, sample.data, frame_count, frames);
+
+    *frames_out = frames;
+    *frame_count_out = frame_count;
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef SAMPLE_FILE_H
+#define SAMPLE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "i2s_frame.h"
+#include "native_sample.h"
+#include "wav_sample.h"
+
+// Parsing for the two sample file formats, WAV and native (see native_sample.h),
+// kept apart from the file system so it builds for the host render harness too.
+// The firmware reads through FatFs, the host through stdio.
+typedef struct sample_reader {
+    void *context;
+    // Reads exactly `byte_count` bytes from the current position.
+    bool (*read)(void *context, void *data, uint32_t byte_count);
+    // Moves to absolute byte `offset`.
+    bool (*seek)(void *context, uint32_t offset);
+    uint32_t (*tell)(void *context);
+    uint32_t size_bytes;
+} sample_reader_t;
+
+// Parses the RIFF header, fmt chunk and (if present) the first smpl loop and leaves
+// the reader positioned at the first byte of the data chunk. `sample->data` is left
+// null. `name` is only used in messages.
+bool parse_wav(const sample_reader_t *reader, const char *name, wav_sample_t *sample);
+
+// Validates a native sample header and leaves the reader positioned at the first frame.
+bool parse_native_sample(const sample_reader_t *reader, const char *name, native_sample_header_t *header);
+
+// Parses either format, detected by its magic. Exactly one of `native`/`wav` is
+// filled in.
+bool parse_sample(const sample_reader_t *reader, const char *name, bool *is_native,
+                  native_sample_header_t *native, wav_sample_t *wav);
+
+sample_encoding_t native_sample_encoding(const native_sample_header_t *header);
+
+// parse_wav() and then reads the whole data chunk into `sample->data`, which the
+// caller frees.
+bool load_wav(const sample_reader_t *reader, const char *name, wav_sample_t *sample);
+
+// Converts `frame_count` frames of 8/16-bit mono/stereo PCM into packed I2S words.
+void convert_pcm_to_i2s_frames(const wav_sample_t &sample, const uint8_t *pcm, size_t frame_count, uint32_t *frames);
+
+// Converts all of a loaded WAV into a newly allocated frame buffer.
+bool build_i2s_frames(const wav_sample_t &sample, uint32_t **frames_out, size_t *frame_count_out);
+
+#endif  // SAMPLE_FILE_H
@@ -0,0 +1,585 @@
+#include "voice_mixer.h"
+
+#include <atomic>
+#include <cstring>
+
+#include "adpcm.h"
+#include "i2s_frame.h"
+#include "mix_kernels.h"
+
+// The note pool, followed by the slots stolen voices fade out in.
+#define VOICE_SLOT_COUNT (MIXER_VOICE_COUNT + VOICE_STEAL_FADE_SLOTS)
+
+static voice_t g_voices[VOICE_SLOT_COUNT];
+static voice_release_callback_t g_release_callback = nullptr;
+static voice_bus_callback_t g_bus_callback = nullptr;
+static envelope_config_t g_envelope_config;
+static voice_steal_policy_t g_steal_policy = VOICE_STEAL_QUIETEST;
+static voice_steal_stats_t g_steal_stats;
+static uint32_t g_note_on_count = 0u;
+
+// Per-block stereo accumulator, interleaved left/right at bus scale (see mix_kernels.h).
+static int32_t g_mix_bus[MIXER_BLOCK_FRAMES * 2u];
+static mix_output_t g_output;
+
+// ADPCM voices are decoded just in time. Each keeps its two most recently used
+// blocks decoded, enough to interpolate across a block edge at any pitch, plus the
+// frames before its loop start that the loop seam fades into.
+typedef struct voice_decode {
+    uint32_t block[2];
+    uint32_t frames[2][ADPCM_BLOCK_FRAMES];
+    uint32_t recent;  // Slot used last.
+    bool lead_valid;
+    uint32_t lead[VOICE_LOOP_XFADE_FRAMES];
+} voice_decode_t;
+
+static voice_decode_t g_decode[VOICE_SLOT_COUNT];
+
+void voice_mixer_init() {
+    std::memset(g_voices, 0, sizeof(g_voices));
+    std::memset(&g_steal_stats, 0, sizeof(g_steal_stats));
+    g_steal_policy = VOICE_STEAL_QUIETEST;
+    g_note_on_count = 0u;
+
+    std::memset(&g_output, 0, sizeof(g_output));
+    g_output.gain_q15 = VOICE_GAIN_UNITY;
+    g_output.dither = true;
+    g_output.seed = 1u;
+
+    g_envelope_config.attack_step = ENVELOPE_LEVEL_MAX;
+    g_envelope_config.decay_step = ENVELOPE_LEVEL_MAX;
+    g_envelope_config.sustain_level = ENVELOPE_LEVEL_MAX;
+    g_envelope_config.release_step = ENVELOPE_LEVEL_MAX;
+}
+
+void voice_mixer_set_envelope(const envelope_config_t *config) {
+    g_envelope_config = *config;
+}
+
+void voice_mixer_set_release_callback(voice_release_callback_t callback) {
+    g_release_callback = callback;
+}
+
+void voice_mixer_set_bus_callback(voice_bus_callback_t callback) {
+    g_bus_callback = callback;
+}
+
+void voice_mixer_set_steal_policy(voice_steal_policy_t policy) {
+    g_steal_policy = policy;
+}
+
+void voice_mixer_set_output(uint16_t gain_q15, bool dither) {
+    g_output.gain_q15 = gain_q15;
+    g_output.dither = dither;
+}
+
+static void free_voice(voice_t *voice) {
+    if (g_release_callback && voice->owner) {
+        g_release_callback(voice->owner);
+    }
+    voice->owner = nullptr;
+    voice->state = VOICE_FREE;
+}
+
+// True if `a` should be stolen before `b` for a new `note`. Apart from a same-note
+// match, voices in release go before held ones and notes not yet started come
+// last (their level is still 0); the policy decides the rest and the older voice
+// breaks ties.
+static bool steal_before(const voice_t *a, const voice_t *b, uint8_t note) {
+    if (g_steal_policy == VOICE_STEAL_SAME_NOTE && (a->note == note) != (b->note == note)) {
+        return a->note == note;
+    }
+
+    const bool a_starting = a->state == VOICE_STARTING;
+    if (a_starting != (b->state == VOICE_STARTING)) {
+        return !a_starting;
+    }
+
+    const bool a_releasing = a->state == VOICE_RELEASING;
+    if (a_releasing != (b->state == VOICE_RELEASING)) {
+        return a_releasing;
+    }
+
+    if (g_steal_policy == VOICE_STEAL_QUIETEST && a->envelope.level != b->envelope.level) {
+        return a->envelope.level < b->envelope.level;
+    }
+    return static_cast<int32_t>(a->start_order - b->start_order) < 0;
+}
+
+// Hands a stolen voice, and its sample reference, to a free fade slot.
+static bool start_steal_fade(voice_t *voice) {
+    for (int i = MIXER_VOICE_COUNT; i < VOICE_SLOT_COUNT; ++i) {
+        voice_t *fade = &g_voices[i];
+        if (fade->state != VOICE_FREE) {
+            continue;
+        }
+
+        *fade = *voice;
+        g_decode[i] = g_decode[voice - g_voices];
+        fade->fade_frames_left = VOICE_STEAL_FADE_FRAMES;
+        std::atomic_signal_fence(std::memory_order_release);
+        fade->state = VOICE_FADING;
+        voice->owner = nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Returns a free voice, or failing that steals one according to the steal policy.
+static voice_t *claim_voice(uint8_t note) {
+    voice_t *victim = nullptr;
+    for (int i = 0; i < MIXER_VOICE_COUNT; ++i) {
+        voice_t *voice = &g_voices[i];
+        // The renderer never moves a voice out of VOICE_FREE, so it is ours to fill.
+        if (voice->state == VOICE_FREE) {
+            return voice;
+        }
+        if (voice->state != VOICE_CLAIMED && (!victim || steal_before(voice, victim, note))) {
+            victim = voice;
+        }
+    }
+
+    if (!victim) {
+        return nullptr;
+    }
+
+    // Park the voice where the renderer ignores it before touching its owner. If the
+    // renderer freed it first, the owner has already been released and is null.
+    // A voice that has not started yet has nothing to fade.
+    const bool audible = victim->state != VOICE_STARTING;
+    victim->state = VOICE_CLAIMED;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    ++g_steal_stats.steals;
+    if (audible && !start_steal_fade(victim)) {
+        ++g_steal_stats.unfaded_steals;
+    }
+    if (g_release_callback && victim->owner) {
+        g_release_callback(victim->owner);
+    }
+    victim->owner = nullptr;
+    return victim;
+}
+
+// Loops keep playing through the release stage; the envelope ends the voice.
+static void set_voice_loop(voice_t *voice, uint32_t loop_start, uint32_t loop_end) {
+    if (loop_end == 0u || loop_start >= loop_end || loop_end > voice->frame_count) {
+        voice->loop_start = 0u;
+        voice->loop_end = 0u;
+        voice->xfade_start = 0u;
+        return;
+    }
+
+    // The crossfade reads as far back as loop_start - xfade, and never takes more than
+    // half the loop so the loop body itself still plays unblended.
+    uint32_t xfade = VOICE_LOOP_XFADE_FRAMES;
+    if (xfade > loop_start) {
+        xfade = loop_start;
+    }
+    if (xfade > (loop_end - loop_start) / 2u) {
+        xfade = (loop_end - loop_start) / 2u;
+    }
+
+    voice->loop_start = loop_start;
+    voice->loop_end = loop_end;
+    voice->xfade_start = loop_end - xfade;
+}
+
+int voice_mixer_note_on(uint8_t note, const voice_params_t *params) {
+    if (!params->data || params->frame_count == 0u) {
+        return -1;
+    }
+
+    voice_t *voice = claim_voice(note);
+    if (!voice) {
+        return -1;
+    }
+
+    const bool adpcm = params->encoding != SAMPLE_ENCODING_FRAMES;
+    voice->frames = adpcm ? nullptr : static_cast<const uint32_t *>(params->data);
+    voice->adpcm = adpcm ? static_cast<const uint8_t *>(params->data) : nullptr;
+    voice->adpcm_channels = static_cast<uint8_t>(adpcm_channel_count(params->encoding));
+    voice_decode_t *decode = &g_decode[voice - g_voices];
+    decode->block[0] = UINT32_MAX;
+    decode->block[1] = UINT32_MAX;
+    decode->lead_valid = false;
+    voice->frame_count = params->frame_count;
+    voice->frames_ready = params->frames_ready;
+    voice->position = 0u;
+    voice->phase = 0u;
+    voice->pitch_step = params->pitch_step ? params->pitch_step : VOICE_PITCH_UNITY;
+    set_voice_loop(voice, params->loop_start, params->loop_end);
+    voice->gain = params->gain;
+    voice->note = note;
+    voice->event_offset = params->block_offset < MIXER_BLOCK_FRAMES ? params->block_offset : MIXER_BLOCK_FRAMES - 1u;
+    voice->stop_offset = UINT32_MAX;
+    voice->start_order = ++g_note_on_count;
+    voice->owner = params->owner;
+    envelope_start(&voice->envelope, &g_envelope_config, params->velocity);
+    // The renderer may run from an IRQ; publish the fields before the state.
+    std::atomic_signal_fence(std::memory_order_release);
+    voice->state = VOICE_STARTING;
+
+    return static_cast<int>(voice - g_voices);
+}
+
+void voice_mixer_note_off(uint8_t note) {
+    voice_mixer_note_off_at(note, 0u);
+}
+
+void voice_mixer_note_off_at(uint8_t note, uint32_t block_offset) {
+    for (int i = 0; i < MIXER_VOICE_COUNT; ++i) {
+        voice_t *voice = &g_voices[i];
+        if (voice->note != note) {
+            continue;
+        }
+        const uint32_t offset = block_offset < MIXER_BLOCK_FRAMES ? block_offset : MIXER_BLOCK_FRAMES - 1u;
+        if (voice->state == VOICE_STARTING) {
+            // Its start offset is still needed; the renderer stops it after starting it.
+            voice->stop_offset = offset;
+        } else if (voice->state == VOICE_PLAYING) {
+            voice->event_offset = offset;
+            std::atomic_signal_fence(std::memory_order_release);
+            voice->state = VOICE_STOPPING;
+        }
+    }
+}
+
+static const uint32_t *decoded_block(voice_t *voice, uint32_t block) {
+    voice_decode_t *decode = &g_decode[voice - g_voices];
+    if (decode->block[decode->recent] != block) {
+        decode->recent ^= 1u;
+        if (decode->block[decode->recent] != block) {
+            adpcm_decode_frames(voice->adpcm, voice->adpcm_channels, block * ADPCM_BLOCK_FRAMES, ADPCM_BLOCK_FRAMES,
+                                decode->frames[decode->recent]);
+            decode->block[decode->recent] = block;
+        }
+    }
+    return decode->frames[decode->recent];
+}
+
+static inline uint32_t voice_frame(voice_t *voice, uint32_t index) {
+    if (!voice->adpcm) {
+        return voice->frames[index];
+    }
+    return decoded_block(voice, index / ADPCM_BLOCK_FRAMES)[index % ADPCM_BLOCK_FRAMES];
+}
+
+// Frames from `index` on as one contiguous run; for an ADPCM voice `count` is cut
+// short at the end of the block.
+static inline const uint32_t *voice_frame_run(voice_t *voice, uint32_t index, uint32_t *count) {
+    if (!voice->adpcm) {
+        return voice->frames + index;
+    }
+    const uint32_t offset = index % ADPCM_BLOCK_FRAMES;
+    if (*count > ADPCM_BLOCK_FRAMES - offset) {
+        *count = ADPCM_BLOCK_FRAMES - offset;
+    }
+    return decoded_block(voice, index / ADPCM_BLOCK_FRAMES) + offset;
+}
+
+// Frame `index` of the stretch just before the loop start that the seam fades into.
+static inline uint32_t lead_frame(voice_t *voice, uint32_t index) {
+    if (!voice->adpcm) {
+        return voice->frames[index];
+    }
+
+    voice_decode_t *decode = &g_decode[voice - g_voices];
+    const uint32_t xfade = voice->loop_end - voice->xfade_start;
+    const uint32_t lead_start = voice->loop_start - xfade;
+    if (!decode->lead_valid) {
+        adpcm_decode_frames(voice->adpcm, voice->adpcm_channels, lead_start, xfade, decode->lead);
+        decode->lead_valid = true;
+    }
+    return decode->lead[index - lead_start];
+}
+
+// The mix functions add `frame_count` frames into `bus` (a position within the mix
+// bus) and take the voice's Q30 gain (Q15 voice gain times Q15 envelope level) at
+// the first frame, ramping it linearly to `gain_end_q30`.
+
+// Frame `index` of a looping voice. Inside the seam the frame is blended towards
+// the one a loop length earlier, reaching it at loop_end, where playback jumps back
+// to loop_start and carries on from exactly the material it faded into.
+static inline uint32_t looped_frame(voice_t *voice, uint32_t index) {
+    const uint32_t tail = voice_frame(voice, index);
+    if (index < voice->xfade_start) {
+        return tail;
+    }
+
+    const uint32_t lead = lead_frame(voice, index - (voice->loop_end - voice->loop_start));
+    const int32_t weight = static_cast<int32_t>(((index - voice->xfade_start) << 15u) /
+                                                (voice->loop_end - voice->xfade_start));  // Q15
+    const int32_t tail_left = i2s_frame_left(tail);
+    const int32_t tail_right = i2s_frame_right(tail);
+    const int32_t left = tail_left + (((i2s_frame_left(lead) - tail_left) * weight) >> 15);
+    const int32_t right = tail_right + (((i2s_frame_right(lead) - tail_right) * weight) >> 15);
+    return pack_i2s_frame(static_cast<int16_t>(left), static_cast<int16_t>(right));
+}
+
+// Scalar mix of the loop seam; at most VOICE_LOOP_XFADE_FRAMES per pass of the loop.
+static void mix_loop_seam(voice_t *voice, int32_t *bus, uint32_t count, int32_t gain_q30,
+                          int32_t gain_step_q30) {
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t frame = looped_frame(voice, voice->position + i);
+        const int32_t gain = gain_q30 >> 15;
+        bus[i * 2u] += (i2s_frame_left(frame) * gain) >> (15 - MIX_BUS_FRAC_BITS);
+        bus[i * 2u + 1u] += (i2s_frame_right(frame) * gain) >> (15 - MIX_BUS_FRAC_BITS);
+        gain_q30 += gain_step_q30;
+    }
+}
+
+// Adds up to `frame_count` frames of `voice` into the mix bus at its recorded pitch.
+// Looping voices are mixed in runs that stop at the seam and at the loop end, ADPCM
+// voices in runs of at most one decoded block.
+// Returns false once the voice has run off the end of its sample.
+static bool mix_voice_direct(voice_t *voice, int32_t *bus, uint32_t frame_count, int32_t gain_start_q30,
+                             int32_t gain_end_q30) {
+    const bool looping = voice->loop_end != 0u;
+    const int32_t gain_step_q30 = (gain_end_q30 - gain_start_q30) / static_cast<int32_t>(frame_count);
+    uint32_t done = 0u;
+
+    while (done < frame_count) {
+        uint32_t run_end = voice->frame_count;
+        if (looping) {
+            run_end = voice->position < voice->xfade_start ? voice->xfade_start : voice->loop_end;
+        }
+        const uint32_t available = run_end - voice->position;
+        uint32_t count = available < frame_count - done ? available : frame_count - done;
+        const int32_t gain_q30 = gain_start_q30 + gain_step_q30 * static_cast<int32_t>(done);
+        int32_t *run_bus = bus + done * 2u;
+
+        if (looping && voice->position >= voice->xfade_start) {
+            mix_loop_seam(voice, run_bus, count, gain_q30, gain_step_q30);
+        } else {
+            const uint32_t *frames = voice_frame_run(voice, voice->position, &count);
+            if (gain_step_q30 == 0) {
+                mix_accumulate_frames(run_bus, frames, count, gain_q30 >> 15);
+            } else {
+                mix_accumulate_frames_ramp(run_bus, frames, count, gain_q30, gain_step_q30);
+            }
+        }
+
+        voice->position += count;
+        done += count;
+        if (looping && voice->position >= voice->loop_end) {
+            voice->position = voice->loop_start;
+        } else if (voice->position >= voice->frame_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Resampling path: steps through the source in Q16.16 increments and linearly
+// interpolates between neighbouring frames, the same fractional-stepping scheme as
+// audio_upsample() in reference/audio_utils.S but on packed stereo frames.
+static bool mix_voice_resampled(voice_t *voice, int32_t *bus, uint32_t frame_count, int32_t gain_start_q30,
+                                int32_t gain_end_q30) {
+    const bool looping = voice->loop_end != 0u;
+    const uint32_t last = voice->frame_count - 1u;
+    const uint32_t loop_length = voice->loop_end - voice->loop_start;
+    const uint32_t step_whole = voice->pitch_step >> 16u;
+    const uint32_t step_fraction = voice->pitch_step & 0xffffu;
+    const int32_t gain_step_q30 = (gain_end_q30 - gain_start_q30) / static_cast<int32_t>(frame_count);
+    int32_t gain_q30 = gain_start_q30;
+    uint32_t position = voice->position;
+    uint32_t phase = voice->phase;
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        uint32_t a;
+        uint32_t b;
+        if (looping) {
+            // The frame after the last one in the loop is loop_start.
+            a = looped_frame(voice, position);
+            b = position + 1u < voice->loop_end ? looped_frame(voice, position + 1u) : voice_frame(voice, voice->loop_start);
+        } else {
+            if (position >= last) {
+                voice->position = position;
+                return false;
+            }
+            a = voice_frame(voice, position);
+            b = voice_frame(voice, position + 1u);
+        }
+
+        const int32_t weight = static_cast<int32_t>(phase >> 1u);  // Q15
+        const int32_t a_left = i2s_frame_left(a);
+        const int32_t a_right = i2s_frame_right(a);
+        const int32_t left = a_left + (((i2s_frame_left(b) - a_left) * weight) >> 15);
+        const int32_t right = a_right + (((i2s_frame_right(b) - a_right) * weight) >> 15);
+        const int32_t gain = gain_q30 >> 15;
+        bus[i * 2u] += (left * gain) >> (15 - MIX_BUS_FRAC_BITS);
+        bus[i * 2u + 1u] += (right * gain) >> (15 - MIX_BUS_FRAC_BITS);
+        gain_q30 += gain_step_q30;
+
+        phase += step_fraction;
+        position += step_whole + (phase >> 16u);
+        phase &= 0xffffu;
+        while (looping && position >= voice->loop_end) {
+            position -= loop_length;
+        }
+    }
+
+    voice->position = position;
+    voice->phase = phase;
+    return true;
+}
+
+static bool mix_voice(voice_t *voice, int32_t *bus, uint32_t frame_count, int32_t gain_start_q30,
+                      int32_t gain_end_q30) {
+    if (voice->pitch_step == VOICE_PITCH_UNITY) {
+        return mix_voice_direct(voice, bus, frame_count, gain_start_q30, gain_end_q30);
+    }
+    return mix_voice_resampled(voice, bus, frame_count, gain_start_q30, gain_end_q30);
+}
+
+// Ramps a stolen voice from its level when stolen to silence over the rest of its
+// fade, then frees it.
+static void mix_steal_fade(voice_t *voice, uint32_t frame_count) {
+    const uint32_t count = voice->fade_frames_left < frame_count ? voice->fade_frames_left : frame_count;
+    const int64_t gain_q30 = voice->gain * (voice->envelope.level >> 15);
+    const int32_t gain_start_q30 = static_cast<int32_t>(gain_q30 * voice->fade_frames_left / VOICE_STEAL_FADE_FRAMES);
+    voice->fade_frames_left -= count;
+    const int32_t gain_end_q30 = static_cast<int32_t>(gain_q30 * voice->fade_frames_left / VOICE_STEAL_FADE_FRAMES);
+
+    if (!mix_voice(voice, g_mix_bus, count, gain_start_q30, gain_end_q30) || voice->fade_frames_left == 0u) {
+        free_voice(voice);
+    }
+}
+
+// Mixes every active voice into g_mix_bus.
+static void mix_block(uint32_t frame_count) {
+    std::memset(g_mix_bus, 0, frame_count * 2u * sizeof(g_mix_bus[0]));
+
+    for (int i = 0; i < VOICE_SLOT_COUNT; ++i) {
+        voice_t *voice = &g_voices[i];
+        if (voice->state == VOICE_FREE || voice->state == VOICE_CLAIMED) {
+            continue;
+        }
+
+        // A voice streaming from a sample that is still loading sits out (silent, with
+        // its note-on/off held back) until the block it needs has arrived.
+        if (voice->frames_ready) {
+            const uint32_t ready = voice->frames_ready->load(std::memory_order_acquire);
+            const uint64_t needed = voice->position + ((static_cast<uint64_t>(frame_count) * voice->pitch_step) >> 16u) + 2u;
+            if (ready >= voice->frame_count) {
+                voice->frames_ready = nullptr;
+            } else if (needed >= ready) {
+                continue;
+            }
+        }
+
+        if (voice->state == VOICE_FADING) {
+            mix_steal_fade(voice, frame_count);
+            continue;
+        }
+
+        // Apply the note-on/off requests made since the last render at their offsets:
+        // a stopping voice holds its level up to the offset, a starting voice is
+        // silent until it.
+        uint32_t offset = 0u;
+        if (voice->state == VOICE_STOPPING) {
+            offset = voice->event_offset < frame_count ? voice->event_offset : frame_count;
+            if (offset > 0u) {
+                const int32_t gain_q30 = voice->gain * (voice->envelope.level >> 15);
+                if (!mix_voice(voice, g_mix_bus, offset, gain_q30, gain_q30)) {
+                    free_voice(voice);
+                    continue;
+                }
+            }
+            envelope_release(&voice->envelope);
+            voice->state = VOICE_RELEASING;
+        }
+        if (voice->state == VOICE_STARTING) {
+            offset = voice->event_offset < frame_count ? voice->event_offset : frame_count;
+            voice->state = VOICE_PLAYING;
+            if (voice->stop_offset != UINT32_MAX) {
+                // Stopped in the block it starts in: attack from the start offset up to
+                // the later of the two offsets, then release, so a short note still sounds.
+                uint32_t stop = voice->stop_offset < frame_count ? voice->stop_offset : frame_count;
+                stop = stop > offset ? stop : offset;
+                voice->stop_offset = UINT32_MAX;
+                const int32_t gain_start_q30 = voice->gain * (voice->envelope.level >> 15);
+                const int32_t gain_end_q30 = voice->gain * (envelope_advance(&voice->envelope, &g_envelope_config) >> 15);
+                if (stop > offset &&
+                    !mix_voice(voice, g_mix_bus + offset * 2u, stop - offset, gain_start_q30, gain_end_q30)) {
+                    free_voice(voice);
+                    continue;
+                }
+                envelope_release(&voice->envelope);
+                voice->state = VOICE_RELEASING;
+                offset = stop;
+            }
+        }
+        if ((voice->state != VOICE_PLAYING && voice->state != VOICE_RELEASING) || offset == frame_count) {
+            continue;
+        }
+
+        // The envelope moves once per block; the gain is ramped across it.
+        const int32_t level_start = voice->envelope.level;
+        const int32_t level_end = envelope_advance(&voice->envelope, &g_envelope_config);
+        const int32_t gain_start_q30 = voice->gain * (level_start >> 15);
+        const int32_t gain_end_q30 = voice->gain * (level_end >> 15);
+
+        const bool more = mix_voice(voice, g_mix_bus + offset * 2u, frame_count - offset, gain_start_q30, gain_end_q30);
+        if (!more || envelope_is_silent(&voice->envelope)) {
+            free_voice(voice);
+        }
+    }
+
+    if (g_bus_callback) {
+        g_bus_callback(g_mix_bus, frame_count);
+    }
+}
+
+void voice_mixer_render(uint32_t *out, uint32_t frame_count) {
+    if (frame_count > MIXER_BLOCK_FRAMES) {
+        frame_count = MIXER_BLOCK_FRAMES;
+    }
+    mix_block(frame_count);
+    mix_output_frames(out, g_mix_bus, frame_count, &g_output);
+}
+
+void voice_mixer_render_32(uint32_t *out, uint32_t frame_count) {
+    if (frame_count > MIXER_BLOCK_FRAMES) {
+        frame_count = MIXER_BLOCK_FRAMES;
+    }
+    mix_block(frame_count);
+    mix_output_words32(out, g_mix_bus, frame_count, &g_output);
+}
+
+uint32_t voice_mixer_active_count() {
+    uint32_t count = 0u;
+    for (int i = 0; i < MIXER_VOICE_COUNT; ++i) {
+        if (g_voices[i].state != VOICE_FREE) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+voice_steal_stats_t voice_mixer_get_steal_stats() {
+    return g_steal_stats;
+}
+
+// 2^(n/12) in Q16 for n = 0..11.
+static const uint32_t k_semitone_ratio_q16[12] = {
+    65536, 69433, 73562, 77936, 82570, 87480, 92682, 98193, 104032, 110218, 116772, 123715,
+};
+
+uint32_t voice_pitch_step(int32_t semitones, uint32_t sample_rate_hz, uint32_t output_rate_hz) {
+    int32_t octave = semitones / 12;
+    int32_t degree = semitones % 12;
+    if (degree < 0) {
+        degree += 12;
+        --octave;
+    }
+
+    uint64_t step = k_semitone_ratio_q16[degree];
+    if (sample_rate_hz != 0u && output_rate_hz != 0u && sample_rate_hz != output_rate_hz) {
+        step = step * sample_rate_hz / output_rate_hz;
+    }
+    step = octave >= 0 ? step << octave : step >> -octave;
+
+    return step > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(step);
+}
@@ -0,0 +1,158 @@
+#ifndef VOICE_MIXER_H
+#define VOICE_MIXER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "envelope.h"
+#include "i2s_frame.h"
+
+// Number of simultaneously sounding voices and the size of one render block.
+// Note-on/off requests take effect in the next rendered block, at the frame offset
+// they carry (256 frames is ~5.8 ms at 44.1 kHz).
+#define MIXER_VOICE_COUNT 16
+#define MIXER_BLOCK_FRAMES 256
+
+// Voice gain is Q15: VOICE_GAIN_UNITY plays the sample at its recorded level. Voices
+// are summed with headroom to spare (see MIX_BUS_FRAC_BITS), so they can all play at
+// unity and the overall level is set once by the output gain.
+#define VOICE_GAIN_UNITY 0x8000u
+
+// Pitch step is Q16.16 source frames per output frame: VOICE_PITCH_UNITY plays the
+// sample at its recorded pitch, 2x VOICE_PITCH_UNITY one octave up.
+#define VOICE_PITCH_UNITY 0x10000u
+
+// Looping voices blend this many frames before the loop end into the frames leading
+// up to the loop start, so the wrap lands on matching material instead of clicking.
+// Shortened for loops that are too short or start too close to the sample start.
+#define VOICE_LOOP_XFADE_FRAMES 64u
+
+// With every voice sounding, note-on steals one according to the steal policy. The
+// stolen voice fades out over VOICE_STEAL_FADE_FRAMES (~2.9 ms at 44.1 kHz) in one
+// of VOICE_STEAL_FADE_SLOTS extra voices, so the new note starts straight away. If
+// every fade slot is busy the stolen voice is cut instead.
+#define VOICE_STEAL_FADE_FRAMES 128u
+#define VOICE_STEAL_FADE_SLOTS 4
+
+typedef enum voice_steal_policy {
+    VOICE_STEAL_OLDEST = 0,  // The voice whose note started longest ago.
+    VOICE_STEAL_QUIETEST,    // The voice with the lowest envelope level.
+    VOICE_STEAL_SAME_NOTE,   // A voice already playing the new note, else the oldest.
+} voice_steal_policy_t;
+
+typedef enum voice_state {
+    VOICE_FREE = 0,
+    VOICE_STARTING,   // note-on received, starts at the next block boundary
+    VOICE_PLAYING,
+    VOICE_STOPPING,   // note-off received, enters release at the next block boundary
+    VOICE_RELEASING,  // still audible, reclaimed once the envelope is silent
+    VOICE_CLAIMED,    // being reassigned by note-on; skipped by the renderer
+    VOICE_FADING,     // stolen; fading out in a steal-fade slot
+} voice_state_t;
+
+typedef struct voice_params {
+    const void *data;        // Packed pack_i2s_frame() words, or ADPCM blocks.
+    sample_encoding_t encoding;
+    uint32_t frame_count;
+    // Frames loaded so far, for a sample still being read in; nullptr if complete.
+    const std::atomic<uint32_t> *frames_ready;
+    uint32_t loop_start;     // Sustain loop in frames; loop_end is exclusive and 0
+    uint32_t loop_end;       // plays the sample once.
+    uint16_t gain;
+    uint8_t velocity;        // 1-127, shortens the envelope attack.
+    uint32_t pitch_step;     // Q16.16; 0 is treated as VOICE_PITCH_UNITY.
+    uint32_t block_offset;   // Frames into the next rendered block where the note starts.
+    const void *owner;       // Handed to the release callback when the voice frees.
+} voice_params_t;
+
+typedef struct voice {
+    const uint32_t *frames;  // nullptr for an ADPCM voice.
+    const uint8_t *adpcm;    // ADPCM blocks, decoded as the voice plays.
+    uint8_t adpcm_channels;
+    uint32_t frame_count;
+    const std::atomic<uint32_t> *frames_ready;  // Cleared once the whole sample is in.
+    uint32_t position;
+    uint32_t phase;          // Q16 fraction of a frame past `position`.
+    uint32_t pitch_step;
+    uint32_t loop_start;
+    uint32_t loop_end;       // 0 when the voice does not loop.
+    uint32_t xfade_start;    // First frame of the seam crossfade, <= loop_end.
+    uint16_t gain;
+    uint8_t note;
+    uint32_t event_offset;   // Block offset of a pending VOICE_STARTING/VOICE_STOPPING.
+    uint32_t stop_offset;    // Note-off offset for a VOICE_STARTING voice; UINT32_MAX when none.
+    uint32_t start_order;    // Note-on count when the voice started, for VOICE_STEAL_OLDEST.
+    uint32_t fade_frames_left;  // VOICE_FADING only.
+    envelope_t envelope;
+    volatile voice_state_t state;
+    const void *owner;
+} voice_t;
+
+typedef struct voice_steal_stats {
+    uint32_t steals;          // Voices taken from a sounding note since init.
+    uint32_t unfaded_steals;  // Of those, cut without a fade because no slot was free.
+} voice_steal_stats_t;
+
+// Called from the renderer whenever a voice returns to VOICE_FREE, e.g. to drop the
+// sample cache reference that kept its frames alive.
+typedef void (*voice_release_callback_t)(const void *owner);
+
+// Called from the renderer with each block's summed voices, interleaved left/right
+// at bus scale (see mix_kernels.h), before the output stage; e.g. an effects chain.
+typedef void (*voice_bus_callback_t)(int32_t *bus, uint32_t frame_count);
+
+// voice_mixer_render() may run from the audio DMA IRQ. Note-on/off only touch a
+// voice's state word last, so they are safe to call from thread context on the
+// same core.
+void voice_mixer_init(void);
+
+void voice_mixer_set_release_callback(voice_release_callback_t callback);
+
+void voice_mixer_set_bus_callback(voice_bus_callback_t callback);
+
+// Sets the ADSR shared by all voices. Call before output starts; until then voices
+// ramp in and out over a single block.
+void voice_mixer_set_envelope(const envelope_config_t *config);
+
+// Chooses which voice note-on steals once none is free; VOICE_STEAL_QUIETEST by
+// default, and reset by voice_mixer_init(). Apart from a same-note match, voices
+// already in release are taken before held ones and notes that have not started
+// sounding yet last, oldest first on a tie.
+void voice_mixer_set_steal_policy(voice_steal_policy_t policy);
+
+// Sets the gain applied to the summed voices before they are saturated to the output
+// width, and whether TPDF dither is added there. Unity gain with dither by default,
+// and reset by voice_mixer_init().
+void voice_mixer_set_output(uint16_t gain_q15, bool dither);
+
+// Claims a free voice for `note`, or steals one by the steal policy if none is free.
+// Returns the voice index, or -1 if the parameters are invalid (in which case the
+// release callback is not called for `params->owner`).
+int voice_mixer_note_on(uint8_t note, const voice_params_t *params);
+
+// Moves every voice currently holding `note` into its release stage.
+void voice_mixer_note_off(uint8_t note);
+
+// As voice_mixer_note_off(), with the release starting `block_offset` frames into
+// the next rendered block.
+void voice_mixer_note_off_at(uint8_t note, uint32_t block_offset);
+
+// Mixes all active voices into `frame_count` packed I2S words (at most
+// MIXER_BLOCK_FRAMES), saturating each channel to 16 bits.
+void voice_mixer_render(uint32_t *out, uint32_t frame_count);
+
+// As voice_mixer_render() for 32-bit I2S slots: 2 * `frame_count` words, left then
+// right, each a 24-bit sample left-justified in the word.
+void voice_mixer_render_32(uint32_t *out, uint32_t frame_count);
+
+// Voices in use, not counting stolen voices still fading out.
+uint32_t voice_mixer_active_count(void);
+
+voice_steal_stats_t voice_mixer_get_steal_stats(void);
+
+// Pitch step that transposes a sample by `semitones` (equal temperament), optionally
+// scaled by the ratio between the sample's recorded rate and the output rate.
+uint32_t voice_pitch_step(int32_t semitones, uint32_t sample_rate_hz, uint32_t output_rate_hz);
+
+#endif  // VOICE_MIXER_H
@@ -0,0 +1,133 @@
+#include "wavetable.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "i2s_frame.h"
+#include "voice_mixer.h"
+
+// The sine needs no band limiting, so all its octaves share one table.
+#define WAVETABLE_TABLE_COUNT (1u + (WAVETABLE_WAVEFORM_COUNT - 1u) * WAVETABLE_OCTAVES)
+
+static const char *const k_waveform_names[WAVETABLE_WAVEFORM_COUNT] = {"sine", "triangle", "saw", "square"};
+
+static uint32_t *g_tables = nullptr;
+
+static uint32_t *table_at(wavetable_waveform_t waveform, uint32_t octave) {
+    const uint32_t index = waveform == WAVETABLE_SINE ? 0u : 1u + (waveform - 1u) * WAVETABLE_OCTAVES + octave;
+    return g_tables + index * WAVETABLE_FRAMES;
+}
+
+// Sine-series amplitude of harmonic `n`.
+static float harmonic_amplitude(wavetable_waveform_t waveform, uint32_t n) {
+    switch (waveform) {
+    case WAVETABLE_TRIANGLE:
+        if (n % 2u == 0u) {
+            return 0.0f;
+        }
+        return (n % 4u == 1u ? 1.0f : -1.0f) / static_cast<float>(n * n);
+    case WAVETABLE_SAW:
+        return (n % 2u == 1u ? 1.0f : -1.0f) / static_cast<float>(n);
+    case WAVETABLE_SQUARE:
+        return n % 2u == 1u ? 1.0f / static_cast<float>(n) : 0.0f;
+    default:
+        return n == 1u ? 1.0f : 0.0f;
+    }
+}
+
+// Sums harmonics 1..`harmonics` into one table, normalised to WAVETABLE_PEAK.
+// Harmonic n at frame i is sine[(n * i) mod WAVETABLE_FRAMES], so the whole build
+// takes WAVETABLE_FRAMES sinf() calls plus one multiply-add per harmonic and frame.
+static void build_table(uint32_t *table, wavetable_waveform_t waveform, uint32_t harmonics, const float *sine,
+                        float *sum) {
+    std::memset(sum, 0, WAVETABLE_FRAMES * sizeof(sum[0]));
+    for (uint32_t n = 1u; n <= harmonics; ++n) {
+        float amplitude = harmonic_amplitude(waveform, n);
+        if (amplitude == 0.0f) {
+            continue;
+        }
+
+        // Lanczos sigma factor.
+        const float x = static_cast<float>(M_PI) * static_cast<float>(n) / static_cast<float>(harmonics + 1u);
+        amplitude *= std::sin(x) / x;
+        for (uint32_t i = 0; i < WAVETABLE_FRAMES; ++i) {
+            sum[i] += amplitude * sine[(n * i) & (WAVETABLE_FRAMES - 1u)];
+        }
+    }
+
+    float peak = 0.0f;
+    for (uint32_t i = 0; i < WAVETABLE_FRAMES; ++i) {
+        peak = std::fabs(sum[i]) > peak ? std::fabs(sum[i]) : peak;
+    }
+    const float scale = peak > 0.0f ? WAVETABLE_PEAK / peak : 0.0f;
+    for (uint32_t i = 0; i < WAVETABLE_FRAMES; ++i) {
+        const int16_t value = static_cast<int16_t>(std::lround(sum[i] * scale));
+        table[i] = pack_i2s_frame(value, value);
+    }
+}
+
+bool wavetable_init() {
+    static_assert((WAVETABLE_FRAMES & (WAVETABLE_FRAMES - 1u)) == 0u, "WAVETABLE_FRAMES must be a power of two");
+
+    if (g_tables) {
+        return true;
+    }
+
+    uint32_t *tables = static_cast<uint32_t *>(std::malloc(WAVETABLE_TABLE_COUNT * WAVETABLE_FRAMES * sizeof(uint32_t)));
+    float *scratch = static_cast<float *>(std::malloc(2u * WAVETABLE_FRAMES * sizeof(float)));
+    if (!tables || !scratch) {
+        std::free(tables);
+        std::free(scratch);
+        return false;
+    }
+
+    float *sine = scratch;
+    float *sum = scratch + WAVETABLE_FRAMES;
+    for (uint32_t i = 0; i < WAVETABLE_FRAMES; ++i) {
+        sine[i] = std::sin(2.0f * static_cast<float>(M_PI) * static_cast<float>(i) / WAVETABLE_FRAMES);
+    }
+
+    g_tables = tables;
+    build_table(table_at(WAVETABLE_SINE, 0u), WAVETABLE_SINE, 1u, sine, sum);
+    for (uint32_t waveform = WAVETABLE_TRIANGLE; waveform < WAVETABLE_WAVEFORM_COUNT; ++waveform) {
+        for (uint32_t octave = 0; octave < WAVETABLE_OCTAVES; ++octave) {
+            // Read at 2^octave frames per output frame, harmonic n of the cycle is at
+            // n * 2^octave / WAVETABLE_FRAMES cycles per output frame: under 1/2.
+            const uint32_t limit = (WAVETABLE_FRAMES / 2u) >> octave;
+            const uint32_t harmonics = limit > 2u ? limit - 1u : 1u;
+            build_table(table_at(static_cast<wavetable_waveform_t>(waveform), octave),
+                        static_cast<wavetable_waveform_t>(waveform), harmonics, sine, sum);
+        }
+    }
+
+    std::free(scratch);
+    return true;
+}
+
+bool wavetable_parse_path(const char *path, wavetable_waveform_t *waveform) {
+    const size_t prefix_length = std::strlen(WAVETABLE_PATH_PREFIX);
+    if (std::strncmp(path, WAVETABLE_PATH_PREFIX, prefix_length) != 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < WAVETABLE_WAVEFORM_COUNT; ++i) {
+        if (std::strcmp(path + prefix_length, k_waveform_names[i]) == 0) {
+            *waveform = static_cast<wavetable_waveform_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const uint32_t *wavetable_table(wavetable_waveform_t waveform, uint32_t pitch_step) {
+    if (!g_tables || waveform >= WAVETABLE_WAVEFORM_COUNT) {
+        return nullptr;
+    }
+
+    uint32_t octave = 0u;
+    while (octave + 1u < WAVETABLE_OCTAVES && pitch_step > (static_cast<uint64_t>(VOICE_PITCH_UNITY) << octave)) {
+        ++octave;
+    }
+    return table_at(waveform, octave);
+}
@@ -0,0 +1,48 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Band-limited single-cycle waveforms, generated into RAM at boot, for synth voices
+// that play with no sample file. A synth voice is an ordinary voice looping over
+// one table cycle, so it shares the voice pool, envelopes and resampler with the
+// sampled ones; its Q16.16 position is the oscillator's phase accumulator.
+//
+// Each waveform has WAVETABLE_OCTAVES tables of WAVETABLE_FRAMES packed frames.
+// Table k holds only the harmonics that stay below Nyquist when the cycle is read
+// at up to 2^k frames per output frame, so picking the table by pitch step keeps
+// every note free of aliasing whatever the output rate. The harmonics are Lanczos
+// smoothed to tame the Gibbs ripple. About 50 KB in all.
+#define WAVETABLE_FRAMES 512u
+#define WAVETABLE_OCTAVES 8u
+#define WAVETABLE_PEAK 16384  // Table peak level, -6 dBFS like a typical recording.
+
+// One cycle played at one frame per output frame at this rate sounds A4, so a synth
+// voice's pitch step is voice_pitch_step(note - WAVETABLE_ROOT_NOTE,
+// WAVETABLE_SAMPLE_RATE_HZ, output_rate_hz).
+#define WAVETABLE_ROOT_NOTE 69u
+#define WAVETABLE_SAMPLE_RATE_HZ (440u * WAVETABLE_FRAMES)
+
+// Keymap paths naming a waveform instead of a file, e.g. "synth:saw".
+#define WAVETABLE_PATH_PREFIX "synth:"
+
+typedef enum wavetable_waveform {
+    WAVETABLE_SINE = 0,
+    WAVETABLE_TRIANGLE,
+    WAVETABLE_SAW,
+    WAVETABLE_SQUARE,
+    WAVETABLE_WAVEFORM_COUNT,
+} wavetable_waveform_t;
+
+// Allocates and fills the tables. Returns false if they do not fit in the heap.
+bool wavetable_init(void);
+
+// True if `path` is WAVETABLE_PATH_PREFIX followed by sine, triangle, saw or square.
+bool wavetable_parse_path(const char *path, wavetable_waveform_t *waveform);
+
+// The table to play `waveform` from at `pitch_step` (Q16.16), or nullptr before a
+// successful wavetable_init().
+const uint32_t *wavetable_table(wavetable_waveform_t waveform, uint32_t pitch_step);
+
+#endif  // WAVETABLE_H
@@ -0,0 +1,281 @@
+#include "adc_scan.h"
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+
+#include "adc_scan.pio.h"
+
+#define ADC_SCAN_PIO pio0
+#define ADC_SCAN_DMA_IRQ DMA_IRQ_0
+
+// Both must match adc_scan.pio.
+#define ADC_SCAN_PIO_PAUSE_IRQ 4u
+#define ADC_SCAN_PIO_CYCLES_PER_CONVERSION 48u
+
+// Transfers per DMA run before the IRQ re-arms it; the largest count the RP2350
+// also reads as a plain count. About 84 minutes of conversions.
+#define ADC_SCAN_DMA_TRANSFERS 0x0FFFFFFFu
+
+static PIO g_pio = nullptr;
+static uint g_sm = 0u;
+static uint g_offset = 0u;
+static uint g_sck_pin = 0u;
+static uint g_mosi_pin = 0u;
+static uint g_dma_tx = 0u;
+static uint g_dma_rx = 0u;
+static uint32_t g_conversion_cycles = 0u;  // System clocks per conversion.
+static uint64_t g_conversion_us_q32 = 0u;  // Microseconds per conversion, Q32.32; set by adc_scan_start().
+static bool g_running = false;
+
+// Keys 0-7 are the first ADC's channels 0-7, keys 8-15 the second's. The DMA rings
+// wrap on the arrays' size, so they are aligned to it.
+static uint32_t g_commands[ADC_SCAN_KEY_COUNT] __attribute__((aligned(sizeof(uint32_t) * ADC_SCAN_KEY_COUNT)));
+static volatile uint16_t g_samples[ADC_SCAN_HISTORY][ADC_SCAN_KEY_COUNT]
+    __attribute__((aligned(sizeof(uint16_t) * ADC_SCAN_KEY_COUNT * ADC_SCAN_HISTORY)));
+
+// Conversions moved by completed RX DMA runs.
+static volatile uint64_t g_result_base = 0u;
+
+// Scan times are worked out from the conversion count, anchored at the last resume
+// and, for conversions before it, at the pause that preceded it. Counts are kept to
+// 32 bits, like the times; the DMA IRQ moves the anchors up every run so the
+// conversions timed from them stay within about two runs.
+static volatile uint32_t g_resume_conversions = 0u;
+static volatile uint32_t g_resume_time_us = 0u;
+static volatile uint32_t g_previous_pause_conversions = 0u;
+static volatile uint32_t g_previous_pause_time_us = 0u;
+static uint32_t g_pause_conversions = 0u;
+static uint32_t g_pause_time_us = 0u;
+
+static uint32_t ring_bits(uint32_t bytes) {
+    uint32_t bits = 0u;
+    while ((1u << bits) < bytes) {
+        ++bits;
+    }
+    return bits;
+}
+
+static uint64_t conversions_done() {
+    const uint32_t status = save_and_disable_interrupts();
+    const uint64_t done = g_result_base + (ADC_SCAN_DMA_TRANSFERS - dma_channel_hw_addr(g_dma_rx)->transfer_count);
+    restore_interrupts(status);
+    return done;
+}
+
+// The whole microseconds wrap with the 32-bit time, which is all that is kept.
+static uint32_t conversions_us(uint32_t conversions) {
+    const uint32_t whole = static_cast<uint32_t>(g_conversion_us_q32 >> 32u);
+    const uint32_t fraction = static_cast<uint32_t>(g_conversion_us_q32);
+    return conversions * whole + static_cast<uint32_t>((static_cast<uint64_t>(conversions) * fraction) >> 32u);
+}
+
+static uint32_t conversion_time_us(uint32_t conversion) {
+    const uint32_t status = save_and_disable_interrupts();
+    const uint32_t resume_conversions = g_resume_conversions;
+    const uint32_t resume_time_us = g_resume_time_us;
+    const uint32_t pause_conversions = g_previous_pause_conversions;
+    const uint32_t pause_time_us = g_previous_pause_time_us;
+    restore_interrupts(status);
+
+    if (static_cast<int32_t>(conversion - resume_conversions) > 0) {
+        return resume_time_us + conversions_us(conversion - resume_conversions);
+    }
+    return pause_time_us - conversions_us(pause_conversions - conversion);
+}
+
+static void __isr adc_scan_irq_handler() {
+    if (dma_channel_get_irq0_status(g_dma_tx)) {
+        dma_channel_acknowledge_irq0(g_dma_tx);
+        dma_channel_set_trans_count(g_dma_tx, ADC_SCAN_DMA_TRANSFERS, true);
+    }
+    if (dma_channel_get_irq0_status(g_dma_rx)) {
+        dma_channel_acknowledge_irq0(g_dma_rx);
+        g_result_base = g_result_base + ADC_SCAN_DMA_TRANSFERS;
+        dma_channel_set_trans_count(g_dma_rx, ADC_SCAN_DMA_TRANSFERS, true);
+
+        // Scanning ran without a break from the resume to here, so this becomes both
+        // anchors. Not while scans from before the resume can still be read; the
+        // next run moves them instead.
+        const uint32_t conversions = static_cast<uint32_t>(g_result_base);
+        if (conversions - g_resume_conversions >= ADC_SCAN_HISTORY * ADC_SCAN_KEY_COUNT) {
+            const uint32_t time_us = g_resume_time_us + conversions_us(conversions - g_resume_conversions);
+            g_resume_conversions = conversions;
+            g_resume_time_us = time_us;
+            g_previous_pause_conversions = conversions;
+            g_previous_pause_time_us = time_us;
+        }
+    }
+}
+
+bool adc_scan_init(uint miso_pin, uint sck_pin, uint mosi_pin, uint cs_adc1, uint cs_adc2) {
+    static_assert((ADC_SCAN_HISTORY & (ADC_SCAN_HISTORY - 1u)) == 0u, "ADC_SCAN_HISTORY must be a power of two");
+
+    if (cs_adc2 != cs_adc1 + 1u) {
+        printf("ADC scan needs CS pins n and n + 1, not %u and %u\n", cs_adc1, cs_adc2);
+        return false;
+    }
+    if (!pio_can_add_program(ADC_SCAN_PIO, &adc_scan_program)) {
+        printf("No room for the ADC scan PIO program\n");
+        return false;
+    }
+
+    const int sm = pio_claim_unused_sm(ADC_SCAN_PIO, false);
+    const int dma_tx = dma_claim_unused_channel(false);
+    const int dma_rx = dma_claim_unused_channel(false);
+    if (sm < 0 || dma_tx < 0 || dma_rx < 0) {
+        printf("No free state machine or DMA channels for the ADC scan\n");
+        if (sm >= 0) {
+            pio_sm_unclaim(ADC_SCAN_PIO, static_cast<uint>(sm));
+        }
+        if (dma_tx >= 0) {
+            dma_channel_unclaim(static_cast<uint>(dma_tx));
+        }
+        if (dma_rx >= 0) {
+            dma_channel_unclaim(static_cast<uint>(dma_rx));
+        }
+        return false;
+    }
+
+    g_pio = ADC_SCAN_PIO;
+    g_sm = static_cast<uint>(sm);
+    g_dma_tx = static_cast<uint>(dma_tx);
+    g_dma_rx = static_cast<uint>(dma_rx);
+    g_sck_pin = sck_pin;
+    g_mosi_pin = mosi_pin;
+    g_offset = pio_add_program(g_pio, &adc_scan_program);
+
+    // Chip in bit 0, then start, single-ended and the channel number MSB first.
+    for (uint key = 0; key < ADC_SCAN_KEY_COUNT; ++key) {
+        const uint channel = key % ADC_SCAN_CHANNELS_PER_ADC;
+        g_commands[key] = (key / ADC_SCAN_CHANNELS_PER_ADC) | (1u << 1u) | (1u << 2u) |
+                          (((channel >> 2u) & 1u) << 3u) | (((channel >> 1u) & 1u) << 4u) | ((channel & 1u) << 5u);
+    }
+
+    // Two state machine cycles per SCK period.
+    const uint32_t sys_hz = clock_get_hz(clk_sys);
+    const uint32_t clkdiv = (sys_hz + 2u * ADC_SCAN_SPI_HZ - 1u) / (2u * ADC_SCAN_SPI_HZ);
+    g_conversion_cycles = ADC_SCAN_PIO_CYCLES_PER_CONVERSION * clkdiv;
+
+    // Paused from the start; the state machine waits at the top of its loop.
+    g_pio->irq_force = 1u << ADC_SCAN_PIO_PAUSE_IRQ;
+    adc_scan_program_init(g_pio, g_sm, g_offset, miso_pin, sck_pin, mosi_pin, cs_adc1, static_cast<uint16_t>(clkdiv));
+    pio_gpio_init(g_pio, cs_adc1);
+    pio_gpio_init(g_pio, cs_adc2);
+
+    dma_channel_config config = dma_channel_get_default_config(g_dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_dreq(&config, pio_get_dreq(g_pio, g_sm, true));
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_ring(&config, false, ring_bits(sizeof(g_commands)));
+    dma_channel_configure(g_dma_tx, &config, &g_pio->txf[g_sm], g_commands, ADC_SCAN_DMA_TRANSFERS, false);
+
+    // The results are right-justified, so the low half of the RX FIFO word is enough.
+    config = dma_channel_get_default_config(g_dma_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_dreq(&config, pio_get_dreq(g_pio, g_sm, false));
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, ring_bits(sizeof(g_samples)));
+    dma_channel_configure(g_dma_rx, &config, g_samples, &g_pio->rxf[g_sm], ADC_SCAN_DMA_TRANSFERS, false);
+
+    dma_channel_set_irq0_enabled(g_dma_tx, true);
+    dma_channel_set_irq0_enabled(g_dma_rx, true);
+    irq_add_shared_handler(ADC_SCAN_DMA_IRQ, adc_scan_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(ADC_SCAN_DMA_IRQ, true);
+
+    dma_start_channel_mask((1u << g_dma_tx) | (1u << g_dma_rx));
+    pio_sm_set_enabled(g_pio, g_sm, true);
+    return true;
+}
+
+void adc_scan_start() {
+    if (!g_pio || g_running) {
+        return;
+    }
+
+    pio_gpio_init(g_pio, g_sck_pin);
+    pio_gpio_init(g_pio, g_mosi_pin);
+
+    // Worked out here rather than per scan: a 64-bit divide is slow on the M0+.
+    const uint32_t sys_hz = clock_get_hz(clk_sys);
+    const uint64_t conversion_cycles_us = static_cast<uint64_t>(g_conversion_cycles) * 1000000u;
+    g_conversion_us_q32 = ((conversion_cycles_us / sys_hz) << 32u) + (((conversion_cycles_us % sys_hz) << 32u) / sys_hz);
+
+    g_previous_pause_conversions = g_pause_conversions;
+    g_previous_pause_time_us = g_pause_time_us;
+    g_resume_conversions = static_cast<uint32_t>(conversions_done());
+    g_resume_time_us = time_us_32();
+    g_running = true;
+    pio_interrupt_clear(g_pio, ADC_SCAN_PIO_PAUSE_IRQ);
+}
+
+void adc_scan_stop() {
+    if (!g_running) {
+        return;
+    }
+
+    g_pio->irq_force = 1u << ADC_SCAN_PIO_PAUSE_IRQ;
+    while (pio_sm_get_pc(g_pio, g_sm) != g_offset + adc_scan_offset_pause) {
+        tight_loop_contents();
+    }
+    // Let the DMA take the last result.
+    while (!pio_sm_is_rx_fifo_empty(g_pio, g_sm)) {
+        tight_loop_contents();
+    }
+
+    g_pause_conversions = static_cast<uint32_t>(conversions_done());
+    g_pause_time_us = time_us_32();
+    g_running = false;
+    gpio_set_function(g_sck_pin, GPIO_FUNC_SPI);
+    gpio_set_function(g_mosi_pin, GPIO_FUNC_SPI);
+}
+
+uint32_t adc_scan_sequence() {
+    if (!g_pio) {
+        return 0u;
+    }
+    return static_cast<uint32_t>(conversions_done() / ADC_SCAN_KEY_COUNT);
+}
+
+uint32_t adc_scan_period_ns() {
+    return static_cast<uint32_t>(static_cast<uint64_t>(g_conversion_cycles) * ADC_SCAN_KEY_COUNT * 1000000000u /
+                                 clock_get_hz(clk_sys));
+}
+
+bool adc_scan_read_sequence(uint32_t sequence, adc_scan_frame_t *frame) {
+    // The row being filled holds the oldest scan, so only the other rows are safe.
+    if (sequence == 0u || sequence > adc_scan_sequence() || adc_scan_sequence() - sequence >= ADC_SCAN_HISTORY - 1u) {
+        return false;
+    }
+
+    const volatile uint16_t *row = g_samples[(sequence - 1u) % ADC_SCAN_HISTORY];
+    for (uint key = 0; key < ADC_SCAN_KEY_COUNT; ++key) {
+        frame->values[key] = row[key];
+    }
+    if (adc_scan_sequence() - sequence >= ADC_SCAN_HISTORY - 1u) {
+        return false;
+    }
+
+    frame->sequence = sequence;
+    frame->time_us = conversion_time_us(sequence * ADC_SCAN_KEY_COUNT);
+    return true;
+}
+
+bool adc_scan_read(adc_scan_frame_t *frame) {
+    uint32_t sequence;
+    do {
+        sequence = adc_scan_sequence();
+        if (sequence == 0u) {
+            return false;
+        }
+    } while (!adc_scan_read_sequence(sequence, frame));
+    return true;
+}
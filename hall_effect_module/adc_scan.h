@@ -0,0 +1,64 @@
+#ifndef ADC_SCAN_H
+#define ADC_SCAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+
+// Continuous scan of the 16 key sensors on the two MCP3208s. A PIO state machine
+// (adc_scan.pio) drives CS, SCK and MOSI itself and walks channels 0-7 of the first
+// chip, then of the second, forever. One DMA channel feeds it the ring of 16
+// conversion commands and another moves each result into a circular array holding
+// the last ADC_SCAN_HISTORY scans of every key. Neither needs the CPU except to be
+// re-armed every ADC_SCAN_DMA_TRANSFERS conversions (over an hour).
+//
+// The conversions are paced by the PIO clock alone, so the scan rate is fixed. The
+// ADCs share SCK, MOSI and MISO with the MCP2515, though: adc_scan_stop() pauses the
+// sequencer between two conversions and hands SCK and MOSI back to the SPI block,
+// and adc_scan_start() takes them back. Scan timestamps allow for the gap.
+//
+// The set pins have to be consecutive, so CS_ADC2 must be CS_ADC1 + 1.
+#define ADC_SCAN_ADC_COUNT 2u
+#define ADC_SCAN_CHANNELS_PER_ADC 8u
+#define ADC_SCAN_KEY_COUNT (ADC_SCAN_ADC_COUNT * ADC_SCAN_CHANNELS_PER_ADC)
+
+// Upper limit on SCK, the MCP3208's clock limit at 3.3 V (between the datasheet's
+// 1 MHz at 2.7 V and 2 MHz at 5 V). The PIO divider is rounded up to a whole
+// number so every SCK period is the same length: 1.276 MHz at 125 MHz, which at
+// 24 SCK periods per conversion is about 3.3k scans of all 16 keys per second.
+#define ADC_SCAN_SPI_HZ 1300000u
+
+// Scans kept per key. A power of two; 32 is about 10 ms.
+#define ADC_SCAN_HISTORY 32u
+
+typedef struct adc_scan_frame {
+    uint32_t sequence;  // Number of scans completed, this one included.
+    uint32_t time_us;   // When the scan completed.
+    uint16_t values[ADC_SCAN_KEY_COUNT];  // 12-bit; keys 0-7 are the first ADC's channels.
+} adc_scan_frame_t;
+
+// Claims a PIO state machine and two DMA channels. The sequencer starts paused,
+// with the chip selects high and SCK and MOSI left to the SPI block.
+bool adc_scan_init(uint miso_pin, uint sck_pin, uint mosi_pin, uint cs_adc1, uint cs_adc2);
+
+// Takes SCK and MOSI and resumes scanning.
+void adc_scan_start(void);
+
+// Lets the conversion in flight finish, then pauses and hands the pins back.
+void adc_scan_stop(void);
+
+// Number of scans completed so far.
+uint32_t adc_scan_sequence(void);
+
+// Time between two scans while scanning, in nanoseconds.
+uint32_t adc_scan_period_ns(void);
+
+// Copies the newest complete scan. Returns false until the first scan completes.
+bool adc_scan_read(adc_scan_frame_t *frame);
+
+// Copies scan number `sequence` (1 for the first). Returns false if it has not
+// completed yet or has already been overwritten.
+bool adc_scan_read_sequence(uint32_t sequence, adc_scan_frame_t *frame);
+
+#endif  // ADC_SCAN_H
@@ -2,10 +2,15 @@
 #include <malloc.h>
 #include <stdint.h>
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
 #include "hardware/spi.h"
 #include "hardware/uart.h"
 
 #include "mcp2515/mcp2515.h"
+#include "adc_scan.h"
+#include "key_calibration.h"
+#include "key_filter.h"
+#include "key_velocity.h"
 
 // SPI Defines (can)
 // We are going to use SPI 0, and allocate it to the following GPIO pins
@@ -16,6 +21,10 @@
 #define PIN_MOSI 19
 
 #define CAN_CS   17
+#define CAN_SPI_HZ (1000 * 1000)
+
+// Must match the controller's CAN_BITRATE, or nothing acknowledges our frames.
+#define CAN_BITRATE CAN_500KBPS
 
 // UART defines
 // By default the stdout UART is `uart0`, so we will use the second one
@@ -38,6 +47,39 @@ volatile uint8_t uart_char = 0;
 #define CS_ADC2 21
 #define NUM_KEYS_PER_ADC 8
 
+// Key events to the controller: data[0] is the MIDI note, data[1] the velocity.
+#define CAN_ID_NOTE_ON 0x100
+#define CAN_ID_NOTE_OFF 0x101
+#define KEY_BASE_NOTE 60        // MIDI note of key 0, middle C.
+
+// Key events wait here for the MCP2515. Each is tried a few times per bus handover;
+// if it still does not go (no controller acknowledging), sending backs off and,
+// once the queue is full, the oldest events are dropped.
+#define KEY_EVENT_QUEUE_LENGTH 32
+#define KEY_EVENT_SEND_ATTEMPTS 2
+#define KEY_EVENT_RETRY_US 10000
+
+// Raw readings at rest and bottomed out for keys that have never been calibrated.
+// The sensors read higher as the magnet comes closer.
+#define KEY_REST_RAW 2048
+#define KEY_BOTTOM_RAW 3500
+
+// UART command that starts a calibration pass; sending it again saves the pass.
+#define CALIBRATE_CHAR 'c'
+
+// Key thresholds in KEY_TRAVEL_FULL units (see key_velocity.h), and the
+// start-to-strike times for velocities 127 and 1.
+#define KEY_START_TRAVEL 150
+#define KEY_RELEASE_TRAVEL 600
+#define KEY_STRIKE_TRAVEL 850
+#define KEY_FASTEST_US 3000
+#define KEY_SLOWEST_US 80000
+#define KEY_CURVE KEY_VELOCITY_CURVE_LINEAR
+
+// Noise band in travel units: each threshold turns on this far above its nominal
+// point and off this far below (see key_filter.h).
+#define KEY_FILTER_HYSTERESIS 12
+
 //      ┌───────────────────────────────────────┐
 //      │          Hall Effect Board            │
 //      └───────────────────────────────────────┘
@@ -93,23 +135,6 @@ void usb_check() {
     printf("USB Input: %c (%d)\n", uart_char, uart_char);
 }
 
-uint16_t mcp3208_read(uint cs_pin, uint8_t channel) {
-    uint8_t tx[3];
-    uint8_t rx[3];
-
-    tx[0] = 0x06 | ((channel & 0x04) >> 2);
-    tx[1] = (channel & 0x03) << 6;
-    tx[2] = 0x00;
-
-    spi_set_baudrate(SPI_PORT, 500 * 1000);  // ADC rate
-    gpio_put(cs_pin, 0);
-    spi_write_read_blocking(SPI_PORT, tx, rx, 3);
-    gpio_put(cs_pin, 1);
-    spi_set_baudrate(SPI_PORT, 1000 * 1000);  // back to CAN rate
-
-    return ((rx[1] & 0x0F) << 8) | rx[2];
-}
-
 // Status LED control and init
 // All the colors are estimated, didn't test on PCB yet
 #define LED_R 10
@@ -137,7 +162,8 @@ typedef enum {
     STATE_BOOT,
     STATE_INIT_OK,
     STATE_IDLE,
-    STATE_ERROR
+    STATE_ERROR,
+    STATE_CALIBRATING
 } system_state_t;
 
 system_state_t current_state = STATE_BOOT;
@@ -156,6 +182,9 @@ void update_led_state() {
         case STATE_ERROR:
             rgb_set(1, 0, 0); // red
             break;
+        case STATE_CALIBRATING:
+            rgb_set(1, 1, 0); // yellow
+            break;
     }
 }
 
@@ -172,6 +201,124 @@ void flash_color(bool r, bool g, bool b, int duration_ms) {
     rgb_set(old_r, old_g, old_b);
 }
 
+key_event_t key_event_queue[KEY_EVENT_QUEUE_LENGTH];
+uint32_t key_event_head = 0;
+uint32_t key_event_count = 0;
+uint32_t key_events_dropped = 0;
+uint32_t key_events_reported_dropped = 0;
+uint32_t key_event_retry_at_us = 0;
+
+void queue_key_event(const key_event_t &event) {
+    if (key_event_count == KEY_EVENT_QUEUE_LENGTH) {
+        key_event_head = (key_event_head + 1) % KEY_EVENT_QUEUE_LENGTH;
+        key_event_count--;
+        key_events_dropped++;
+    }
+    key_event_queue[(key_event_head + key_event_count) % KEY_EVENT_QUEUE_LENGTH] = event;
+    key_event_count++;
+}
+
+bool send_key_event(MCP2515 &mcp2515, const key_event_t &event) {
+    can_frame frame;
+    frame.can_id = event.on ? CAN_ID_NOTE_ON : CAN_ID_NOTE_OFF;
+    frame.can_dlc = 2;
+    frame.data[0] = KEY_BASE_NOTE + event.key;
+    frame.data[1] = event.velocity;
+    for (int attempt = 0; attempt < KEY_EVENT_SEND_ATTEMPTS; attempt++) {
+        if (mcp2515.sendMessage(&frame) == MCP2515::ERROR_OK) {
+            return true;
+        }
+        sleep_us(100);  // wait buffer
+    }
+    return false;
+}
+
+// Sends the queued events in one bus handover. No logging in here: the keys are not
+// being scanned until it returns.
+void flush_key_events(MCP2515 &mcp2515) {
+    if (key_event_count == 0 || (int32_t)(time_us_32() - key_event_retry_at_us) < 0) {
+        return;
+    }
+
+    // The MCP2515 shares the bus with the scan.
+    adc_scan_stop();
+    while (key_event_count > 0 && send_key_event(mcp2515, key_event_queue[key_event_head])) {
+        key_event_head = (key_event_head + 1) % KEY_EVENT_QUEUE_LENGTH;
+        key_event_count--;
+    }
+    adc_scan_start();
+
+    if (key_event_count > 0) {
+        key_event_retry_at_us = time_us_32() + KEY_EVENT_RETRY_US;
+    }
+    if (key_events_dropped != key_events_reported_dropped) {
+        printf("Pico2: %lu key events dropped, is the controller on the bus?\n", (unsigned long)key_events_dropped);
+        key_events_reported_dropped = key_events_dropped;
+    }
+}
+
+// Runs the key state machines on every scan since the last call and sends the note
+// events. Scans overwritten before they could be read are skipped.
+void process_key_scans(MCP2515 &mcp2515, uint32_t *next_scan) {
+    const uint32_t newest = adc_scan_sequence();
+    if (newest >= *next_scan && newest - *next_scan >= ADC_SCAN_HISTORY - 1) {
+        *next_scan = newest;
+    }
+
+    for (; *next_scan <= newest; ++*next_scan) {
+        adc_scan_frame_t scan;
+        if (!adc_scan_read_sequence(*next_scan, &scan)) {
+            continue;
+        }
+
+        if (key_calibration_active()) {
+            key_calibration_sample(scan.values);
+            continue;
+        }
+
+        uint16_t travel[ADC_SCAN_KEY_COUNT];
+        key_calibration_normalise(scan.values, travel);
+        key_filter_process(travel, travel);
+
+        key_event_t events[KEY_VELOCITY_KEY_COUNT];
+        const uint32_t count = key_velocity_update(travel, scan.time_us, events);
+        for (uint32_t i = 0; i < count; i++) {
+            queue_key_event(events[i]);
+        }
+    }
+
+    flush_key_events(mcp2515);
+}
+
+// First call: start recording with every key up, then sweep each key to the bottom
+// and back. Second call: save the rest and bottom-out readings.
+void toggle_calibration(MCP2515 &mcp2515) {
+    if (!key_calibration_active()) {
+        // No key events during the pass, so nothing may be left sounding.
+        key_event_t events[KEY_VELOCITY_KEY_COUNT];
+        const uint32_t count = key_velocity_release_all(events);
+        for (uint32_t i = 0; i < count; i++) {
+            queue_key_event(events[i]);
+        }
+        flush_key_events(mcp2515);
+
+        key_calibration_begin();
+        current_state = STATE_CALIBRATING;
+        update_led_state();
+        printf("Pico2: calibrating, sweep every key then send '%c' again\n", CALIBRATE_CHAR);
+        return;
+    }
+
+    if (key_calibration_finish()) {
+        printf("Pico2: calibration saved\n");
+    } else {
+        printf("Pico2: calibration not saved\n");
+    }
+    key_filter_init(KEY_FILTER_HYSTERESIS);
+    current_state = STATE_IDLE;
+    update_led_state();
+}
+
 
 
 
@@ -188,7 +335,7 @@ int main()
     printf("System Booting...\n");
 
     // SPI initialisation. This example will use SPI at 1MHz.
-    spi_init(SPI_PORT, 1000*1000);
+    spi_init(SPI_PORT, CAN_SPI_HZ);
     gpio_set_function(PIN_MISO, GPIO_FUNC_SPI);
     gpio_set_function(PIN_SCK,  GPIO_FUNC_SPI);
     gpio_set_function(PIN_MOSI, GPIO_FUNC_SPI);
@@ -221,7 +368,7 @@ int main()
     MCP2515 mcp2515(SPI_PORT, CAN_CS, PIN_MOSI, PIN_MISO, PIN_SCK);
 
     mcp2515.reset();
-    mcp2515.setBitrate(CAN_500KBPS, MCP_8MHZ);
+    mcp2515.setBitrate(CAN_BITRATE, MCP_8MHZ);
     mcp2515.setNormalMode();
 
     printf("CAN Initialized\n");
@@ -300,15 +447,63 @@ int main()
         gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
         gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
 
+        // The keys are scanned continuously by PIO; the bus only goes back to the
+        // MCP2515 while a scan is being sent.
+        if (!adc_scan_init(PIN_MISO, PIN_SCK, PIN_MOSI, CS_ADC1, CS_ADC2) ||
+            !key_velocity_init(KEY_START_TRAVEL, KEY_STRIKE_TRAVEL, KEY_RELEASE_TRAVEL)) {
+            current_state = STATE_ERROR;
+            update_led_state();
+            while (true) {
+                sleep_ms(1000);
+            }
+        }
+        key_velocity_set_curve(KEY_FASTEST_US, KEY_SLOWEST_US, KEY_CURVE);
+        key_filter_init(KEY_FILTER_HYSTERESIS);
+        if (!key_calibration_init(KEY_REST_RAW, KEY_BOTTOM_RAW)) {
+            printf("Pico2: keys not calibrated, send '%c' to calibrate\n", CALIBRATE_CHAR);
+        }
+        adc_scan_start();
+
+        adc_scan_frame_t last_scan = {};
+        uint32_t next_scan = 1;
         while (true) {
+            // Note events from the keys; a '1' over UART still dumps one raw scan.
+            process_key_scans(mcp2515, &next_scan);
+
             if (uart_is_readable(UART_ID)) {
                 uint8_t c = uart_getc(UART_ID);
+                if (c == CALIBRATE_CHAR) {
+                    toggle_calibration(mcp2515);
+                    continue;
+                }
                 if (c != '1') {
                     continue;
                 }
                 printf("Pico2: UART received '%c'\n", c);
                 flash_color(1, 1, 0, 30);  // yellow, UART
 
+                adc_scan_frame_t scan;
+                if (!adc_scan_read(&scan)) {
+                    continue;
+                }
+                adc_scan_stop();
+                if (last_scan.sequence != 0 && scan.time_us != last_scan.time_us) {
+                    const uint32_t rate = (uint32_t)((uint64_t)(scan.sequence - last_scan.sequence) * 1000000u /
+                                                     (scan.time_us - last_scan.time_us));
+                    printf("Pico2: scanning each key at %lu Hz\n", (unsigned long)rate);
+                }
+
+                const key_filter_stats_t filter = key_filter_get_stats();
+                if (filter.frames != 0) {
+                    const uint32_t cycles = (uint32_t)(filter.cycles / filter.frames);
+                    const uint32_t scan_cycles =
+                        (uint32_t)((uint64_t)adc_scan_period_ns() * clock_get_hz(clk_sys) / 1000000000u);
+                    const uint32_t permille = scan_cycles != 0 ? cycles * 1000u / scan_cycles : 0;
+                    printf("Pico2: key filter takes %lu cycles per scan, %lu.%lu%% of the scan period\n",
+                           (unsigned long)cycles, (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+                    key_filter_reset_stats();
+                }
+
                 can_frame start;
                 start.can_id = 0x200;
                 start.can_dlc = 1;
@@ -325,7 +520,7 @@ int main()
 
                 // two ADC channels - ADC 1
                 for (int ch = 0; ch < NUM_KEYS_PER_ADC; ch++) {
-                    uint16_t adc1 = mcp3208_read(CS_ADC1, ch);
+                    uint16_t adc1 = scan.values[ch];
                     printf("Pico2: ADC1_CH%d=%d\n", ch, adc1);
                     flash_color(0, 1, 1, 10);  // cyan
 
@@ -340,7 +535,7 @@ int main()
 
                 // ADC2
                 for (int ch = 0; ch < NUM_KEYS_PER_ADC; ch++) {
-                    uint16_t adc2 = mcp3208_read(CS_ADC2, ch);
+                    uint16_t adc2 = scan.values[NUM_KEYS_PER_ADC + ch];
                     printf("Pico2: ADC2_CH%d=%d\n", ch, adc2);
                     flash_color(0, 1, 1, 10); // cyan
 
@@ -364,6 +559,11 @@ int main()
                }
                flash_color(1, 1, 1, 20); // white, CAN end
                // sleep_ms(5);
+
+                // Rate check for the next request, over the scans made while it waits.
+                adc_scan_start();
+                sleep_ms(100);
+                adc_scan_read(&last_scan);
             }
 
             sleep_ms(1);
@@ -0,0 +1,176 @@
+#include "key_calibration.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "key_velocity.h"
+
+#define KEY_CALIBRATION_MAGIC 0x4B43414Cu  // "KCAL"
+#define KEY_CALIBRATION_VERSION 1u
+
+// The last sector of flash, well clear of the program image.
+#define KEY_CALIBRATION_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+typedef struct stored_calibration {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t rest[KEY_CALIBRATION_KEY_COUNT];
+    uint16_t bottom[KEY_CALIBRATION_KEY_COUNT];
+    uint32_t crc;  // CRC-32 of everything before it.
+} stored_calibration_t;
+
+static_assert(sizeof(stored_calibration_t) <= FLASH_PAGE_SIZE, "Calibration must fit in one flash page");
+
+extern "C" char __flash_binary_end;
+
+static uint16_t g_rest[KEY_CALIBRATION_KEY_COUNT];
+static uint16_t g_bottom[KEY_CALIBRATION_KEY_COUNT];
+
+// Normalisation table: travel = ((raw - g_offset) * g_gain) >> KEY_CALIBRATION_GAIN_SHIFT.
+static int32_t g_offset[KEY_CALIBRATION_KEY_COUNT];
+static int32_t g_gain[KEY_CALIBRATION_KEY_COUNT];
+
+// Calibration pass in progress.
+static bool g_active = false;
+static uint32_t g_scans = 0u;
+static uint32_t g_rest_sum[KEY_CALIBRATION_KEY_COUNT];
+static uint16_t g_low[KEY_CALIBRATION_KEY_COUNT];
+static uint16_t g_high[KEY_CALIBRATION_KEY_COUNT];
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (uint32_t bit = 0; bit < 8u; ++bit) {
+            crc = (crc >> 1u) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void build_table() {
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        const int32_t span = static_cast<int32_t>(g_bottom[key]) - static_cast<int32_t>(g_rest[key]);
+        g_offset[key] = g_rest[key];
+        g_gain[key] = span != 0 ? static_cast<int32_t>(KEY_TRAVEL_FULL << KEY_CALIBRATION_GAIN_SHIFT) / span : 0;
+    }
+}
+
+static bool save() {
+    if (reinterpret_cast<uintptr_t>(&__flash_binary_end) - XIP_BASE > KEY_CALIBRATION_FLASH_OFFSET) {
+        printf("Program image runs into the calibration sector\n");
+        return false;
+    }
+
+    static uint8_t page[FLASH_PAGE_SIZE];
+    stored_calibration_t stored;
+    stored.magic = KEY_CALIBRATION_MAGIC;
+    stored.version = KEY_CALIBRATION_VERSION;
+    memcpy(stored.rest, g_rest, sizeof(stored.rest));
+    memcpy(stored.bottom, g_bottom, sizeof(stored.bottom));
+    stored.crc = crc32(reinterpret_cast<const uint8_t *>(&stored), offsetof(stored_calibration_t, crc));
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &stored, sizeof(stored));
+
+    // Nothing may run from flash while it is written. The scan's PIO and DMA only
+    // touch RAM and carry on.
+    const uint32_t status = save_and_disable_interrupts();
+    flash_range_erase(KEY_CALIBRATION_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(KEY_CALIBRATION_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(status);
+    return true;
+}
+
+bool key_calibration_init(uint16_t default_rest, uint16_t default_bottom) {
+    const stored_calibration_t *stored =
+        reinterpret_cast<const stored_calibration_t *>(XIP_BASE + KEY_CALIBRATION_FLASH_OFFSET);
+    const bool valid = stored->magic == KEY_CALIBRATION_MAGIC && stored->version == KEY_CALIBRATION_VERSION &&
+                       stored->crc == crc32(reinterpret_cast<const uint8_t *>(stored),
+                                            offsetof(stored_calibration_t, crc));
+
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        g_rest[key] = valid ? stored->rest[key] : default_rest;
+        g_bottom[key] = valid ? stored->bottom[key] : default_bottom;
+    }
+    build_table();
+    return valid;
+}
+
+void key_calibration_begin() {
+    g_scans = 0u;
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        g_rest_sum[key] = 0u;
+        g_low[key] = 0xFFFFu;
+        g_high[key] = 0u;
+    }
+    g_active = true;
+}
+
+bool key_calibration_active() {
+    return g_active;
+}
+
+void key_calibration_sample(const uint16_t *raw) {
+    if (!g_active) {
+        return;
+    }
+
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        if (g_scans < KEY_CALIBRATION_REST_SCANS) {
+            g_rest_sum[key] += raw[key];
+        }
+        g_low[key] = raw[key] < g_low[key] ? raw[key] : g_low[key];
+        g_high[key] = raw[key] > g_high[key] ? raw[key] : g_high[key];
+    }
+    ++g_scans;
+}
+
+bool key_calibration_finish() {
+    if (!g_active) {
+        return false;
+    }
+    g_active = false;
+
+    if (g_scans < KEY_CALIBRATION_REST_SCANS) {
+        printf("Calibration needs at least %u scans, got %lu\n", KEY_CALIBRATION_REST_SCANS,
+               static_cast<unsigned long>(g_scans));
+        return false;
+    }
+
+    // Bottom-out is whichever extreme is further from rest.
+    uint32_t swept = 0u;
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        const uint16_t rest = static_cast<uint16_t>(g_rest_sum[key] / KEY_CALIBRATION_REST_SCANS);
+        const uint16_t bottom = g_high[key] - rest >= rest - g_low[key] ? g_high[key] : g_low[key];
+        const uint32_t span = bottom > rest ? bottom - rest : rest - bottom;
+        if (span < KEY_CALIBRATION_MIN_SPAN) {
+            printf("Key %lu not swept (%u-%u), keeping %u-%u\n", static_cast<unsigned long>(key), rest, bottom,
+                   g_rest[key], g_bottom[key]);
+            continue;
+        }
+
+        g_rest[key] = rest;
+        g_bottom[key] = bottom;
+        ++swept;
+    }
+    if (swept == 0u) {
+        return false;
+    }
+
+    build_table();
+    return save();
+}
+
+void key_calibration_normalise(const uint16_t *raw, uint16_t *travel) {
+    for (uint32_t key = 0; key < KEY_CALIBRATION_KEY_COUNT; ++key) {
+        int32_t value = ((static_cast<int32_t>(raw[key]) - g_offset[key]) * g_gain[key]) >> KEY_CALIBRATION_GAIN_SHIFT;
+        value = value < 0 ? 0 : value;
+        value = value > static_cast<int32_t>(KEY_TRAVEL_FULL) ? static_cast<int32_t>(KEY_TRAVEL_FULL) : value;
+        travel[key] = static_cast<uint16_t>(value);
+    }
+}
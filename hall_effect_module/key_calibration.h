@@ -0,0 +1,42 @@
+#ifndef KEY_CALIBRATION_H
+#define KEY_CALIBRATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-key normalisation from raw MCP3208 counts to key travel (0 at rest,
+// KEY_TRAVEL_FULL bottomed out, see key_velocity.h). Every magnet and sensor sits
+// a little differently, so each key has its own rest and bottom-out readings,
+// recorded in a calibration pass while the keys are swept. They are kept in the
+// last sector of flash behind a CRC and loaded at boot.
+//
+// Normalising is one multiply and one shift per key: each key's rest reading and a
+// signed gain, so sensors that read lower when pressed work the same way.
+#define KEY_CALIBRATION_KEY_COUNT 16u
+#define KEY_CALIBRATION_GAIN_SHIFT 16u
+
+// Smallest rest-to-bottom difference that counts as a swept key, in raw counts.
+#define KEY_CALIBRATION_MIN_SPAN 200u
+
+// Scans averaged for the rest readings at the start of a pass; the keys must be up.
+#define KEY_CALIBRATION_REST_SCANS 64u
+
+// Loads the stored calibration, or sets every key to `default_rest` and
+// `default_bottom` if there is none or it fails its CRC. Returns false in the
+// latter case.
+bool key_calibration_init(uint16_t default_rest, uint16_t default_bottom);
+
+// Starts a calibration pass. Until key_calibration_finish(), every scan should go
+// to key_calibration_sample().
+void key_calibration_begin(void);
+bool key_calibration_active(void);
+void key_calibration_sample(const uint16_t *raw);
+
+// Ends the pass and saves it to flash. Keys that were not swept keep their old
+// calibration. Returns false, saving nothing, if no key was swept.
+bool key_calibration_finish(void);
+
+// Converts one scan of raw readings to travel.
+void key_calibration_normalise(const uint16_t *raw, uint16_t *travel);
+
+#endif  // KEY_CALIBRATION_H
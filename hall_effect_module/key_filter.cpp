@@ -0,0 +1,84 @@
+#include "key_filter.h"
+
+#include "hardware/structs/systick.h"
+
+#define SYSTICK_MASK 0x00FFFFFFu
+#define SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK 0x5u
+
+static int32_t g_hysteresis = 0;
+static bool g_primed = false;
+
+// One array per stage, indexed by key.
+static uint16_t g_previous[KEY_FILTER_KEY_COUNT];
+static uint16_t g_before_previous[KEY_FILTER_KEY_COUNT];
+static int32_t g_smoothed[KEY_FILTER_KEY_COUNT];  // Travel << KEY_FILTER_FRAC_BITS.
+static int32_t g_output[KEY_FILTER_KEY_COUNT];
+
+static key_filter_stats_t g_stats = {};
+
+void key_filter_init(uint16_t hysteresis) {
+    g_hysteresis = hysteresis;
+    g_primed = false;
+
+    // SysTick counts down at the processor clock; 24 bits is well over one scan.
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0u;
+    systick_hw->csr = SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK;
+    key_filter_reset_stats();
+}
+
+void key_filter_process(const uint16_t *travel, uint16_t *filtered) {
+    const uint32_t start = systick_hw->cvr;
+
+    if (!g_primed) {
+        for (uint32_t key = 0; key < KEY_FILTER_KEY_COUNT; ++key) {
+            g_previous[key] = travel[key];
+            g_before_previous[key] = travel[key];
+            g_smoothed[key] = static_cast<int32_t>(travel[key]) << KEY_FILTER_FRAC_BITS;
+            g_output[key] = travel[key];
+            filtered[key] = travel[key];
+        }
+        g_primed = true;
+        return;
+    }
+
+    const int32_t hysteresis = g_hysteresis;
+    for (uint32_t key = 0; key < KEY_FILTER_KEY_COUNT; ++key) {
+        const int32_t a = g_before_previous[key];
+        const int32_t b = g_previous[key];
+        const int32_t c = travel[key];
+        g_before_previous[key] = static_cast<uint16_t>(b);
+        g_previous[key] = static_cast<uint16_t>(c);
+
+        const int32_t low = a < b ? a : b;
+        const int32_t high = a < b ? b : a;
+        const int32_t capped = high < c ? high : c;
+        const int32_t median = low > capped ? low : capped;
+
+        int32_t smoothed = g_smoothed[key];
+        smoothed += ((median << KEY_FILTER_FRAC_BITS) - smoothed) >> KEY_FILTER_SHIFT;
+        g_smoothed[key] = smoothed;
+        const int32_t value = smoothed >> KEY_FILTER_FRAC_BITS;
+
+        int32_t output = g_output[key];
+        if (value > output + hysteresis) {
+            output = value - hysteresis;
+        } else if (value < output - hysteresis) {
+            output = value + hysteresis;
+        }
+        g_output[key] = output;
+        filtered[key] = static_cast<uint16_t>(output);
+    }
+
+    g_stats.frames++;
+    g_stats.cycles += (start - systick_hw->cvr) & SYSTICK_MASK;
+}
+
+key_filter_stats_t key_filter_get_stats() {
+    return g_stats;
+}
+
+void key_filter_reset_stats() {
+    g_stats.frames = 0u;
+    g_stats.cycles = 0u;
+}
@@ -0,0 +1,38 @@
+#ifndef KEY_FILTER_H
+#define KEY_FILTER_H
+
+#include <stdint.h>
+
+// Noise filter between calibration and the key state machines, run once per scan
+// on all 16 keys' travel in one loop. Each key's state sits in its own array, one
+// per stage, so the loop only does sequential loads and stores. All integer:
+//
+// - a 3-tap median, which removes single-scan spikes outright,
+// - a one-pole low-pass, y += (x - y) >> KEY_FILTER_SHIFT, kept with
+//   KEY_FILTER_FRAC_BITS extra bits so small steps are not lost,
+// - backlash hysteresis: the output only follows the input once the input has
+//   moved `hysteresis` past it. Every threshold downstream then has separate on
+//   and off points, 2 * `hysteresis` apart, and noise sitting on a threshold
+//   cannot toggle it. A monotonic press shifts every crossing equally, so
+//   crossing times are unchanged.
+//
+// The time spent is counted in CPU cycles per scan.
+#define KEY_FILTER_KEY_COUNT 16u
+#define KEY_FILTER_SHIFT 1u      // 1/2 per scan: a time constant of about 2 scans.
+#define KEY_FILTER_FRAC_BITS 4u
+
+typedef struct key_filter_stats {
+    uint32_t frames;
+    uint64_t cycles;
+} key_filter_stats_t;
+
+// `hysteresis` is in travel units. Also starts the SysTick counter used for timing.
+void key_filter_init(uint16_t hysteresis);
+
+// Filters one scan. The first scan after init primes the filter and passes through.
+void key_filter_process(const uint16_t *travel, uint16_t *filtered);
+
+key_filter_stats_t key_filter_get_stats(void);
+void key_filter_reset_stats(void);
+
+#endif  // KEY_FILTER_H
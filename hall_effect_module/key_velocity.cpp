@@ -0,0 +1,181 @@
+#include "key_velocity.h"
+
+#include <stdio.h>
+
+#define KEY_VELOCITY_MAX 127u
+#define KEY_VELOCITY_CURVE_STEPS 128u
+#define KEY_VELOCITY_DEFAULT_FASTEST_US 2000u
+#define KEY_VELOCITY_DEFAULT_SLOWEST_US 100000u
+
+static uint16_t g_start_travel = 0u;
+static uint16_t g_strike_travel = 0u;
+static uint16_t g_release_travel = 0u;
+static uint32_t g_fastest_us = KEY_VELOCITY_DEFAULT_FASTEST_US;
+static uint32_t g_slowest_us = KEY_VELOCITY_DEFAULT_SLOWEST_US;
+
+// Velocity for key speeds from slowest (step 0) to fastest.
+static uint8_t g_curve[KEY_VELOCITY_CURVE_STEPS];
+
+static key_state_t g_state[KEY_VELOCITY_KEY_COUNT];
+static uint16_t g_previous_travel[KEY_VELOCITY_KEY_COUNT];
+static uint16_t g_timed_from[KEY_VELOCITY_KEY_COUNT];  // Threshold the running timing started at.
+static uint32_t g_timing_start_us[KEY_VELOCITY_KEY_COUNT];
+static uint32_t g_previous_time_us = 0u;
+static bool g_primed = false;
+
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0u;
+    while ((root + 1u) * (root + 1u) <= value) {
+        ++root;
+    }
+    return root;
+}
+
+// When travel passed `threshold` between the previous scan and this one, assuming
+// it moved linearly in between.
+static uint32_t crossing_time_us(uint16_t threshold, uint16_t previous, uint16_t current, uint32_t time_us) {
+    const uint32_t elapsed_us = time_us - g_previous_time_us;
+    if (current == previous) {
+        return time_us;
+    }
+    const int32_t part = static_cast<int32_t>(threshold) - static_cast<int32_t>(previous);
+    const int32_t whole = static_cast<int32_t>(current) - static_cast<int32_t>(previous);
+    if (part <= 0 || whole <= 0) {
+        return g_previous_time_us;
+    }
+    return g_previous_time_us + static_cast<uint32_t>(static_cast<uint64_t>(elapsed_us) * part / whole);
+}
+
+static uint8_t velocity_for(uint32_t travel_us) {
+    if (travel_us <= g_fastest_us) {
+        return KEY_VELOCITY_MAX;
+    }
+    if (travel_us >= g_slowest_us) {
+        return 1u;
+    }
+
+    // Speed relative to the slowest and fastest: (1/t - 1/slow) / (1/fast - 1/slow).
+    const uint64_t step = static_cast<uint64_t>(g_slowest_us - travel_us) * g_fastest_us *
+                          (KEY_VELOCITY_CURVE_STEPS - 1u) /
+                          (static_cast<uint64_t>(travel_us) * (g_slowest_us - g_fastest_us));
+    return g_curve[step < KEY_VELOCITY_CURVE_STEPS ? step : KEY_VELOCITY_CURVE_STEPS - 1u];
+}
+
+static void start_timing(uint32_t key, uint16_t threshold, uint16_t current, uint32_t time_us) {
+    g_state[key] = KEY_TRAVELLING;
+    g_timed_from[key] = threshold;
+    g_timing_start_us[key] = crossing_time_us(threshold, g_previous_travel[key], current, time_us);
+}
+
+bool key_velocity_init(uint16_t start_travel, uint16_t strike_travel, uint16_t release_travel) {
+    if (!(start_travel < release_travel && release_travel < strike_travel && strike_travel <= KEY_TRAVEL_FULL)) {
+        printf("Key thresholds need start < release < strike <= %u, not %u, %u, %u\n", KEY_TRAVEL_FULL,
+               start_travel, release_travel, strike_travel);
+        return false;
+    }
+
+    g_start_travel = start_travel;
+    g_strike_travel = strike_travel;
+    g_release_travel = release_travel;
+    for (uint32_t key = 0; key < KEY_VELOCITY_KEY_COUNT; ++key) {
+        g_state[key] = KEY_IDLE;
+        g_previous_travel[key] = 0u;
+    }
+    g_primed = false;
+    key_velocity_set_curve(KEY_VELOCITY_DEFAULT_FASTEST_US, KEY_VELOCITY_DEFAULT_SLOWEST_US, KEY_VELOCITY_CURVE_LINEAR);
+    return true;
+}
+
+void key_velocity_set_curve(uint32_t fastest_us, uint32_t slowest_us, key_velocity_curve_t curve) {
+    g_fastest_us = fastest_us;
+    g_slowest_us = slowest_us > fastest_us ? slowest_us : fastest_us + 1u;
+
+    const uint32_t top = KEY_VELOCITY_CURVE_STEPS - 1u;
+    for (uint32_t step = 0; step < KEY_VELOCITY_CURVE_STEPS; ++step) {
+        uint32_t shaped = step;  // Out of `top`.
+        if (curve == KEY_VELOCITY_CURVE_SOFT) {
+            shaped = isqrt(step * top);
+        } else if (curve == KEY_VELOCITY_CURVE_HARD) {
+            shaped = step * step / top;
+        }
+        g_curve[step] = static_cast<uint8_t>(1u + (KEY_VELOCITY_MAX - 1u) * shaped / top);
+    }
+}
+
+uint32_t key_velocity_update(const uint16_t *travel, uint32_t time_us, key_event_t *events) {
+    if (!g_primed) {
+        for (uint32_t key = 0; key < KEY_VELOCITY_KEY_COUNT; ++key) {
+            g_previous_travel[key] = travel[key];
+        }
+        g_previous_time_us = time_us;
+        g_primed = true;
+        return 0u;
+    }
+
+    uint32_t count = 0u;
+    for (uint32_t key = 0; key < KEY_VELOCITY_KEY_COUNT; ++key) {
+        const uint16_t current = travel[key];
+
+        if (g_state[key] == KEY_STRUCK) {
+            g_state[key] = KEY_HELD;
+        }
+        if (g_state[key] == KEY_IDLE && current >= g_start_travel) {
+            start_timing(key, g_start_travel, current, time_us);
+        } else if (g_state[key] == KEY_RELEASED) {
+            if (current < g_start_travel) {
+                g_state[key] = KEY_IDLE;
+            } else if (current >= g_release_travel) {
+                start_timing(key, g_release_travel, current, time_us);
+            }
+        }
+
+        if (g_state[key] == KEY_TRAVELLING) {
+            if (current >= g_strike_travel) {
+                // Scale a repeat's shorter run to the full start-to-strike distance.
+                const uint32_t strike_us = crossing_time_us(g_strike_travel, g_previous_travel[key], current, time_us);
+                const uint32_t timed_us = strike_us - g_timing_start_us[key];
+                const uint32_t travel_us = static_cast<uint32_t>(
+                    static_cast<uint64_t>(timed_us) * (g_strike_travel - g_start_travel) /
+                    (g_strike_travel - g_timed_from[key]));
+
+                g_state[key] = KEY_STRUCK;
+                events[count].key = static_cast<uint8_t>(key);
+                events[count].on = true;
+                events[count].velocity = velocity_for(travel_us);
+                ++count;
+            } else if (current < g_timed_from[key]) {
+                // Pressed part way and let go: no note.
+                g_state[key] = g_timed_from[key] == g_start_travel ? KEY_IDLE : KEY_RELEASED;
+            }
+        } else if (g_state[key] == KEY_HELD && current < g_release_travel) {
+            g_state[key] = current < g_start_travel ? KEY_IDLE : KEY_RELEASED;
+            events[count].key = static_cast<uint8_t>(key);
+            events[count].on = false;
+            events[count].velocity = 0u;
+            ++count;
+        }
+
+        g_previous_travel[key] = current;
+    }
+    g_previous_time_us = time_us;
+    return count;
+}
+
+uint32_t key_velocity_release_all(key_event_t *events) {
+    uint32_t count = 0u;
+    for (uint32_t key = 0; key < KEY_VELOCITY_KEY_COUNT; ++key) {
+        if (g_state[key] == KEY_STRUCK || g_state[key] == KEY_HELD) {
+            events[count].key = static_cast<uint8_t>(key);
+            events[count].on = false;
+            events[count].velocity = 0u;
+            ++count;
+        }
+        g_state[key] = KEY_IDLE;
+    }
+    g_primed = false;
+    return count;
+}
+
+key_state_t key_velocity_state(uint32_t key) {
+    return key < KEY_VELOCITY_KEY_COUNT ? g_state[key] : KEY_IDLE;
+}
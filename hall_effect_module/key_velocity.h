@@ -0,0 +1,60 @@
+#ifndef KEY_VELOCITY_H
+#define KEY_VELOCITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-key note detection from hall sensor travel, one state machine per key:
+//
+//   idle -> travelling -> struck -> held -> released -> idle
+//
+// A key starts travelling when it passes the start threshold and is struck when it
+// reaches the strike threshold. The time between the two crossings, interpolated
+// between scans, gives the velocity. The note stops when the key comes back above
+// the release threshold. A released key that goes down again before it is back past
+// the start threshold is timed from the release threshold instead, so fast
+// repetitions sound without a full key lift.
+//
+// Travel is in KEY_TRAVEL_FULL units: 0 at rest, KEY_TRAVEL_FULL bottomed out.
+#define KEY_VELOCITY_KEY_COUNT 16u
+#define KEY_TRAVEL_FULL 1024u
+
+typedef enum key_state {
+    KEY_IDLE = 0,
+    KEY_TRAVELLING,
+    KEY_STRUCK,  // For the one scan in which the note-on was raised.
+    KEY_HELD,
+    KEY_RELEASED,
+} key_state_t;
+
+typedef enum key_velocity_curve {
+    KEY_VELOCITY_CURVE_LINEAR = 0,
+    KEY_VELOCITY_CURVE_SOFT,  // Square root: loud notes come easier.
+    KEY_VELOCITY_CURVE_HARD,  // Square: loud notes take a harder strike.
+} key_velocity_curve_t;
+
+typedef struct key_event {
+    uint8_t key;
+    bool on;
+    uint8_t velocity;  // 1-127 for note-on, 0 for note-off.
+} key_event_t;
+
+// Resets every key to idle, and the curve to linear between 2 ms and 100 ms. Needs
+// start < release < strike.
+bool key_velocity_init(uint16_t start_travel, uint16_t strike_travel, uint16_t release_travel);
+
+// Start-to-strike times for velocities 127 and 1, and the curve between them; the
+// curve is applied to key speed, not time.
+void key_velocity_set_curve(uint32_t fastest_us, uint32_t slowest_us, key_velocity_curve_t curve);
+
+// Runs every key's state machine on one scan. Writes up to KEY_VELOCITY_KEY_COUNT
+// events and returns how many.
+uint32_t key_velocity_update(const uint16_t *travel, uint32_t time_us, key_event_t *events);
+
+// Returns every key to idle, for when the scans stop being fed in. Writes a note-off
+// for each key that was sounding and returns how many; the next scan starts afresh.
+uint32_t key_velocity_release_all(key_event_t *events);
+
+key_state_t key_velocity_state(uint32_t key);
+
+#endif  // KEY_VELOCITY_H